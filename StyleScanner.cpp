@@ -13,29 +13,541 @@
 #include <cstring>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <new>
+#include <cstdint>
+#include <climits>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <unordered_map>
+
+// Platform-specific headers
+#ifdef __unix__
+#include <sys/resource.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <cerrno>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#endif
 using namespace std;
 
+// Global allocation count
+//   Only counted in builds with COUNT_ALLOCATIONS defined, to see
+//   what a scan allocates once buffers are warm (none, for a file
+//   scanned before; see tests/alloc_test.cpp).
+long allocationCount = 0;
+#ifdef COUNT_ALLOCATIONS
+const bool COUNTING_ALLOCATIONS = true;
+#ifdef __GNUC__
+#define NO_INLINE __attribute__((noinline))
+#else
+#define NO_INLINE
+#endif
+
+// Counting replacement for global operator new
+//   Not inlined, so GCC doesn't pair its malloc with the
+//   library's delete & warn of a mismatch.
+NO_INLINE void* operator new(size_t size) {
+	allocationCount++;
+	void *block = malloc(size ? size : 1);
+	if (!block) {
+		throw bad_alloc();
+	}
+	return block;
+}
+
+// Matching replacement for global operator delete
+NO_INLINE void operator delete(void *block) noexcept {
+	free(block);
+}
+
+// Sized form, used for deletes of complete objects
+NO_INLINE void operator delete(void *block, size_t) noexcept {
+	free(block);
+}
+#else
+const bool COUNTING_ALLOCATIONS = false;
+#endif
+
+// Enumeration for rules that a profile may enable or disable
+enum Rules {RULE_ANY_COMMENTS = 0, RULE_HEADER_START, RULE_HEADER_FORMAT,
+	RULE_FUNCTION_LENGTH, RULE_TAB_USAGE, RULE_INDENT_LEVELS,
+	RULE_LINE_LENGTH, RULE_VARIABLE_NAMES, RULE_CONSTANT_NAMES,
+	RULE_FUNCTION_NAMES, RULE_CLASS_NAMES, RULE_EXTRANEOUS_BLANKS,
+	RULE_PUNCTUATION_SPACING, RULE_SPACED_OPERATORS,
+	RULE_FUNCTION_LEAD_COMMENTS, RULE_BLANKS_BEFORE_COMMENTS,
+	RULE_TOO_FEW_COMMENTS, RULE_TOO_MANY_COMMENTS,
+	RULE_START_SPACE_COMMENTS, RULE_ENDLINE_COMMENTS,
+	RULE_ENDLINE_RUNON_COMMENTS, NUM_RULES};
+
+// Rule names as used in profile files
+const string RULE_NAMES[NUM_RULES] = {"AnyComments", "HeaderStart",
+	"HeaderFormat", "FunctionLength", "TabUsage", "IndentLevels",
+	"LineLength", "VariableNames", "ConstantNames", "FunctionNames",
+	"ClassNames", "ExtraneousBlanks", "PunctuationSpacing",
+	"SpacedOperators", "FunctionLeadComments", "BlanksBeforeComments",
+	"TooFewComments", "TooManyComments", "StartSpaceComments",
+	"EndlineComments", "EndlineRunonComments"};
+
+// Rule profile: thresholds & enabled rules for a course
+struct RuleProfile {
+	int maxLineLength = 80;
+	int maxFunctionLength = 25;
+	int maxInlineLength = 1;
+	int maxUncommentedLines = 25;
+	bool ruleEnabled[NUM_RULES] = {};
+	RuleProfile();
+};
+
+// Largest threshold a profile may set
+const int MAX_PROFILE_VALUE = 100000;
+
+// Compiled profile file header
+//   Followed by the RuleProfile bytes, then the baseline span hashes.
+//   Sizes are checked on load, so a file from another build (or an
+//   older format) is rejected rather than misread.
+struct ProfileFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t profileBytes;
+	uint32_t hashBytes;
+	uint32_t reserved;
+	uint64_t numBaselineSpans;
+};
+
+// Enumeration for timed scan stages
+enum ScanStages {STAGE_READ = 0, STAGE_PRESCAN, STAGE_CHECK, NUM_STAGES};
+
+// Stage names & latency histogram bounds (seconds) for metrics
+const string STAGE_NAMES[] = {"read", "prescan", "check"};
+const int NUM_BUCKETS = 9;
+const double BUCKET_BOUNDS[NUM_BUCKETS] = {0.0001, 0.0005, 0.001,
+	0.005, 0.01, 0.05, 0.1, 0.5, 1.0};
+
+// ScanMetrics class
+//   Operational counters & per-stage latency histograms,
+//   exported in Prometheus text format.
+class ScanMetrics {
+	public:
+		void recordFile(long bytes, long lines);
+		void recordFailure();
+		void recordStage(int stage, double seconds);
+		void recordAllocations(long count);
+		void recordMemo(long hits, long lookups);
+		void recordFunctionCache(long hits, long lookups);
+		long getMemoHits();
+		long getMemoLookups();
+		long getFunctionHits();
+		long getFunctionLookups();
+		void writeFile(const string &name);
+
+	private:
+		void printCounter(const string &name, const string &help, long value,
+			ostream &out);
+		void printHistogram(ostream &out);
+		void printMemoCounters(ostream &out);
+		void printHistogramStage(ostream &out, const string &name, int stage);
+
+		// Member data
+		long filesScanned = 0;
+		long filesFailed = 0;
+		long bytesScanned = 0;
+		long linesScanned = 0;
+		long stageCounts[NUM_STAGES][NUM_BUCKETS + 1] = {};
+		double stageSums[NUM_STAGES] = {};
+		long scanAllocations = 0;
+		long lastScanAllocations = 0;
+		long memoHits = 0;
+		long memoLookups = 0;
+		long functionHits = 0;
+		long functionLookups = 0;
+};
+
+// Most error lines shown per check in text reports
+const int MAX_SHOWN = 3;
+
+// LineList class
+//   Error line numbers from one check, stored as runs of
+//   consecutive lines (e.g., every line of a badly indented file
+//   is one run). The first runs are held inline; more spill to the
+//   heap. An optional cap keeps only the first lines, and counts
+//   the rest as overflow.
+class LineList {
+	public:
+		LineList(int maxLines = 0);
+		void add(int line);
+		void clear();
+		int size() const;
+		int operator[](int index) const;
+		int getNumRuns() const;
+		int getRunFirst(int index) const;
+		int getRunLast(int index) const;
+		long getHeapBytes() const;
+
+	private:
+		struct LineRun {
+			int first;
+			int last;
+		};
+		LineRun &getRun(int index);
+		const LineRun &getRun(int index) const;
+
+		// Member data
+		static const int INLINE_RUNS = 4;
+		LineRun inlineRuns[INLINE_RUNS];
+		vector<LineRun> extraRuns;
+		int maxStored;
+		int numRuns = 0;
+		int numStored = 0;
+		int numTotal = 0;
+};
+
+// MemoryBuf class
+//   Stream buffer over bytes already in memory (no copy).
+class MemoryBuf: public streambuf {
+	public:
+		MemoryBuf(char *data, size_t size);
+};
+
+// PipeBuf class
+//   Input stream buffer over a C stdio stream, e.g., from popen().
+class PipeBuf: public streambuf {
+	public:
+		PipeBuf(FILE *input);
+
+	protected:
+		int underflow();
+
+	private:
+		FILE *inFile;
+		char buffer[65536];
+};
+
+// OutputBuf class
+//   Output stream buffer that collects writes in one large block for
+//   a C stdio stream, writing only when full or flushed.
+class OutputBuf: public streambuf {
+	public:
+		OutputBuf(FILE *output);
+
+	protected:
+		int overflow(int c);
+		int sync();
+
+	private:
+		int writeBuffer();
+		FILE *outFile;
+		char buffer[65536];
+};
+
+// HuffmanTable struct
+//   Canonical Huffman decoding table: number of codes of each bit
+//   length, & symbols ordered by code.
+struct HuffmanTable {
+	short counts[16];
+	short symbols[288];
+};
+
+// Inflater class
+//   Decoder for raw DEFLATE data (RFC 1951), as in zip & gzip files.
+//   Bit-by-bit canonical decoding: small & dependency-free, rather
+//   than fast; scanning the output costs far more.
+class Inflater {
+	public:
+		Inflater();
+		bool inflate(const char *data, size_t size, string &out,
+			size_t maxSize);
+
+	private:
+		bool decodeBlocks();
+		int getBits(int count);
+		bool copyStored();
+		bool decodeDynamic();
+		bool readCodeLengths(short *lengths, int count,
+			const HuffmanTable &codeTable);
+		bool decodeCodes(const HuffmanTable &lengthTable,
+			const HuffmanTable &distanceTable);
+		int buildTable(HuffmanTable &table, const short *lengths, int count);
+		int decodeSymbol(const HuffmanTable &table);
+
+		// Member data
+		HuffmanTable fixedLengths;
+		HuffmanTable fixedDistances;
+		const unsigned char *input = nullptr;
+		size_t inputSize = 0;
+		size_t inputPos = 0;
+		long bitBuffer = 0;
+		int bitCount = 0;
+		bool isOverrun = false;
+		string *output = nullptr;
+		size_t outputLimit = 0;
+};
+
+// SimilarityIndex class
+//   Inverted index from token fingerprints to files, for finding
+//   near-duplicate pairs without comparing every pair of files.
+class SimilarityIndex {
+	public:
+		void addFile(const string &name, const vector<size_t> &fingerprints);
+		void printPairs(int minPercent);
+
+	private:
+		void countShared(int maxFiles);
+		void countDistinct(int maxFiles);
+
+		// Member data
+		vector<string> names;
+		unordered_map<size_t, vector<int> > postings;
+		unordered_map<long long, int> sharedCounts;
+		vector<int> distinctCounts;
+};
+
+// BatchSummary class
+//   Aggregate results for a batch, kept as running totals: files
+//   failing each rule, the distribution of lines flagged per file for
+//   each rule, & the worst files (rather than every report).
+class BatchSummary {
+	public:
+		void addError(const string &message, int numLines);
+		void endFile(const string &name);
+		void print();
+		void printJson();
+
+	private:
+		struct FileScore {
+			int numRules;
+			int numLines;
+			string name;
+		};
+		static bool isWorse(const FileScore &a, const FileScore &b);
+		vector<pair<int, string> > getRulesByFiles();
+		string getBucketName(int bucket);
+		string getRuleJson(const string &rule);
+		int getPercent(int count);
+
+		// Member data
+		map<string, int> ruleFiles;
+		map<string, vector<int> > ruleBuckets;
+		vector<FileScore> worstFiles;
+		int numFiles = 0;
+		int numClean = 0;
+		int fileRules = 0;
+		int fileLines = 0;
+};
+
+// Diagnostic struct
+//   One reported error over a run of lines, as sent to an editor.
+struct Diagnostic {
+	int firstLine;
+	int lastLine;
+	string message;
+};
+
+// CachedFunction struct
+//   Line verdicts for one function in the function cache.
+//   Age counts runs since last use, for evicting stale entries.
+struct CachedFunction {
+	vector<unsigned> verdicts;
+	int age;
+};
+
+// OpenFunction struct
+//   A function being measured in a streamed file, by header line.
+//   Length is -1 until the end of the function is read.
+struct OpenFunction {
+	int start;
+	int scope;
+	int limit;
+	int length;
+};
+
+// StreamState struct
+//   Prescan & whole-file rule state carried along a streamed file,
+//   so each window of lines scans as it would in the whole file.
+struct StreamState {
+	bool inCstyleComment = false;
+	int braceLevel = 0;
+	int labelLevel = 0;
+	bool inClassHeader = false;
+	int firstComment = -1;
+	int gapStart = -1;
+	int gapSearch = 0;
+	vector<OpenFunction> functions;
+};
+
 // StyleScanner class
 class StyleScanner {
 	public:
 		void printBanner();
 		void printUsage();
+		void printLongOptions();
 		void parseArgs(int argc, char** argv);
 		void parseFunctionArg(char* arg);
+		void parseLongArg(char* arg);
+		void parseLongValueArg(char* arg);
+		void parseLongModeArg(char* arg);
+		string getOptionValue(int argc, char** argv, int &index);
+		bool loadProfile(const string &name);
+		bool loadBaseline(const string &name);
+		bool getCompileMode();
+		bool writeCompiledProfile();
+		bool reloadProfileIfRequested();
 		bool getExitAfterArgs();
-		bool readFile();
+		int getNumFiles();
+
+		// File & batch scanning
+		void reset();
+		bool readFile(int index);
+		void scanFile(int index);
+		bool scanBatch();
+		bool isSourceName(const string &name);
 		void writeFile();
 		void checkErrors();
+		void applyEdit(int start, int numOld,
+			const vector<string> &newLines);
 		void showTokens();
 
+		// Metrics & summary reports
+		void writeMetrics();
+		void printMemoryReport();
+		void printMemorySummary();
+		void printMemoSummary();
+		void writeFunctionCache();
+		void printSimilarPairs();
+		void printBatchSummary();
+		void finishBatch();
+
+		// Editor (LSP) support
+		void loadText(const string &text);
+		void setCollectMode();
+		void adoptProfile(const StyleScanner &source);
+		int getNumDiagnostics();
+		Diagnostic getDiagnostic(int index);
+		int getNumLines();
+		string getLine(int line);
+		bool getLspMode();
+
+		// Watch mode support
+		bool getWatchMode();
+		string getFileName(int index);
+		int getFileIndex(const string &name);
+		bool isDirectory(const string &name);
+
 	private:
 
+		// Test access to internals (see tests/)
+		friend class ScannerTest;
+
 		// Initial file scanning
+		void startFile(const string &name, bool showName);
+		bool readFileText();
+		bool readStreamText(istream &in);
+		bool readStreamBytes(istream &in, long size);
+		bool appendStreamText(istream &in);
+		void printReadError();
+		bool loadReadText();
+		void loadFileText();
+		void checkLoadedFile();
+
+		// Tar archive input
+		bool isTarName(const string &name);
+		bool isTarData(const string &text);
+		void scanTarFile(const string &name);
+		void scanGzipTarFile(const string &name);
+		void scanTarText();
+		bool scanInputArchive();
+		void scanTarStream(istream &in, const string &archiveName);
+		string getTarName(const char *header);
+		void readTarLongName(istream &in, long size, string &name,
+			bool isPax);
+		void readTarPaxName(istream &in, long size, string &name);
+		bool parsePaxRecord(const string &text,
+			size_t &pos, string &path);
+		bool isTarSourceEntry(const char *header, const string &name);
+		bool scanStreamMember(istream &in, const string &name, long size);
+
+		// Pipeline input (file lists & framed records)
+		bool readFileList(const string &name);
+		void loadProjectTypes();
+		bool scanFramedInput();
+
+		// Zip archive input
+		bool isZipName(const string &name);
+		bool isZipData(const string &text);
+		void scanZipFile(const string &name);
+		void scanZipText();
+		void scanZipArchive(const string &archiveName);
+		size_t findZipDirectoryEnd();
+		size_t getZipEntryEnd(size_t entry);
+		void scanZipMember(const string &name, size_t entry);
+		bool decodeZipMember(size_t entry);
+		size_t getZipDataStart(size_t entry);
+
+		// Streamed scanning (through a window of lines)
+		void scanStreamFile(int index);
+		bool openStreamFile(ifstream &inFile);
+		bool isStreamableText();
+		void scanStreamLines(istream &in);
+		void startStream();
+		bool readStreamBlock(istream &in);
+		bool readStreamLine(istream &in, string &line);
+		void skipStreamLineEnd(size_t end);
+		bool fillStreamWindow(istream &in);
+		bool addStreamLine(istream &in);
+		void prescanStreamLine(int i);
+		void trackStreamComments(int i);
+		void flagStreamGap(int span);
+		void trackStreamFunctions(int i);
+		void flushStreamFunctions(int numLines);
+		void checkStreamWindow();
+		void slideStreamWindow();
+		bool keepStreamErrors();
+		void finishStream();
+
+		// Line splitting & prescan
+		void splitFileLines();
+		void normalizeFileText();
+		bool isUtf16Text();
+		void convertUtf16Text();
+		void normalizeLineEnds();
+		void resizeFileLines(int numLines);
+		void prescanFile();
 		void scanCommentLines();
 		void scanNewTypeDefs();
+		void scanNewTypeDef(int i);
+		void addNewType(const string &name);
+		void clearNewTypes();
 		void scanScopeLevels();
+		int scanBraceLevels(int start, int end, int level);
+		void setScopeLevels();
+		void setScopeLevel(int i);
+		bool scanCommentLine(int i, bool inCstyleComment);
 		void scanScopeLabels();
+		int scanScopeLabel(int i, int labelLevel);
+		void keyNewTypes();
+
+		// Incremental prescan after an edit
+		int getBraceLevelBefore(int line);
+		void spliceLines(int start, int numOld,
+			const vector<string> &newLines);
+		void spliceLevels(vector<int> &levels, int start, int numOld,
+			int numNew);
+		int rescanComments(int start, int editEnd);
+		int rescanBraceLevels(int start, int end, int startLevel);
+		void rescanScopeLevels(int start, int end, int delta);
+		void rescanNewTypes(int start, int oldEnd, int end);
 
 		// Utility functions
 		int getLength(const string &line);
@@ -43,14 +555,81 @@ class StyleScanner {
 		int getSize(const vector<int> &vec);
 
 		// Helper functions
-		void printError(const string &error);
-		void printErrors(const string &error, const vector<int> &lines);
+		void checkArgFiles();
+		void printError(const char *error);
+		void printErrors(const char *error);
+		void printErrorLines(const char *error);
+		void collectErrors(const char *error);
+		void flagLine(int line);
+		bool isBaselineLine(int line);
+		void flagRange(int first, int last, int line);
+
+		// Line-local rules & verdict memo
+		void checkLineRule(int rule, const char *error);
+		bool hasLineError(int rule, int line);
+		bool isLineError(int rule, int line);
+		unsigned getLineVerdicts(int line);
+		void memoLineVerdicts();
+		unsigned getMemoVerdicts(int line);
+		bool isFunctionStart(int line);
+		int cacheFunctionVerdicts(int start);
+		void loadFunctionCache();
+		bool hasFunctionCacheRoom();
+		size_t getVerdictKey(int line);
+		size_t getTextHash(const string &s, int start, int end);
+
+		// Starter baseline matching
+		void markBaselineLines();
+		size_t getLineHash(const string &line);
+		size_t getSpanHash(const vector<size_t> &hashes, int start);
+		bool hasWordChars(const vector<string> &lines, int start);
+
+		// Changed lines from a diff (pre-commit mode)
+		bool loadDiffFiles();
+		void readDiff(istream &in);
+		string getDiffPath(const string &header);
+		void markDiffLines();
+		bool readNamedText();
+		bool readStagedText();
+		bool readCommandText(const string &command);
+
+		// Compressed input
+		bool isGzipData(const string &text);
+		bool inflateGzipText();
+		size_t getGzipDataStart(const string &data);
+		size_t skipGzipString(const string &data, size_t pos);
+
+		// Token fingerprints for similarity
+		void fingerprintFile();
+		void addTokenHashes(const string &line);
+		bool isKeywordHash(size_t hash);
+		void winnowFingerprints();
+
+		// More helper functions
 		int getFirstCommentLine();
 		int getFirstNonspacePos(const string &line);
 		int getLastNonspacePos(const string &line);
 		int getStartTabCount(const string &line);
 		int getFunctionLengthLimit(bool inClassHeader);
 		int countFunctionLength(int startLine);
+		bool isRuleOn(int rule);
+		bool startCheck(int rule);
+		bool isWholeFileRule(int rule);
+		bool parseProfileLine(const string &line, RuleProfile &newProfile);
+		bool loadTextProfile(istream &in);
+		bool loadCompiledProfile(istream &in);
+		bool readBaselineSpans(istream &in, uint64_t count);
+		uint64_t getRemainingBytes(istream &in);
+		bool isValidProfile(const RuleProfile &newProfile);
+		void setProfile(const RuleProfile &newProfile);
+		bool setProfileValue(const string &key, const string &value,
+			RuleProfile &newProfile);
+		int getProfileNumber(const string &value);
+		void markStage(int stage);
+		long getHeapBytes(const string &s);
+		long getHeapBytes(const vector<string> &vec);
+		long getHeapBytes(const vector<int> &vec);
+		long getPeakRssKb();
 		
 		// Boolean helper functions
 		bool isIndentTabs(int line);
@@ -79,7 +658,9 @@ class StyleScanner {
 		string getLastToken(const string &s);
 		int findTokenEnd(const string &s, int pos);
 		bool isBasicType(const string &s);
+		bool startsWithBasicType(const string &s);
 		bool isNewType(const string &s);
+		bool startsWithProjectType(const string &s);
 		bool isAnyType(const string &s);
 		bool isOkConstant(const string &s);
 		bool isOkVariable(const string &s);
@@ -89,12 +670,20 @@ class StyleScanner {
 		bool isStartParen(const string &s);
 		bool isFunctionHeader(const string &s);
 		bool isFunctionHeader(const string &s, string &name);
+		bool findFunctionName(const string &s, int &start, int &end);
 		bool isClassHeader(const string &s);
 		bool isClassKeyword(const string &s);
 		bool isPreprocessorDirective(const string &s);
 		bool stringStartsWith(const string &s, const string &t);
 		bool stringEndsWith(const string &s, const string &t);
 
+		// Non-copying token helper functions
+		bool getNextToken(const string &s, int &pos, string &token);
+		bool findNextToken(const string &s, int &pos, int &start);
+		bool isFirstToken(const string &s, const string &t);
+		bool firstTokenStartsWith(const string &s, const string &t);
+		bool lastTokenEndsWith(const string &s, const string &t);
+
 		// Critical items
 		void checkCriticalErrors();
 		void checkAnyComments();
@@ -114,6 +703,12 @@ class StyleScanner {
 		void checkClassNames();
 		void checkPunctuationSpacing();
 		void checkSpacedOperators();
+		bool isLongLine(int line);
+		bool isBadVariableLine(int i);
+		bool isBadConstantLine(int i);
+		bool isBadFunctionLine(int i);
+		bool isBadPunctuationLine(int i);
+		bool isBadOperatorLine(int i);
 
 		// Documentation items
 		void checkDocumentationErrors();
@@ -124,18 +719,200 @@ class StyleScanner {
 		void checkEndlineRunonComments();
 		void checkStartSpaceComments();
 		void checkFunctionLeadComments();
+		bool isEndlineCommentLine(int line);
+		bool isBadCommentStartLine(int i);
 		void checkNoErrors();
 
 		// Member data
+		vector<string> fileNames;
 		string fileName;
+		string fileText;
+		char readBuffer[BUFSIZ];
 		bool anyErrors = false;
 		bool exitAfterArgs = false;
 		bool doFunctionCommentCheck = true;
 		bool doFunctionLengthCheck = true;
+		bool doMemoryReport = false;
+		bool lspMode = false;
+		bool watchMode = false;
+		bool doMemo = false;
+		bool framedMode = false;
+		int similarPercent = 0;
+		bool isCollecting = false;
+		vector<Diagnostic> diagnostics;
+		string archiveText;
+		Inflater inflater;
+
+		// Per-file scan data
 		vector<string> fileLines;
+		vector<string> spareLines;
 		vector<string> newTypes;
+		vector<string> spareTypes;
+		vector<int> newTypeLines;
+		size_t typesKey = 0;
 		vector<int> commentLines;
 		vector<int> scopeLevels;
+		vector<int> braceLevels;
+		vector<int> labelLevels;
+		LineList errorLines = LineList(MAX_SHOWN);
+
+		// Streamed scan window & kept errors
+		static const int STREAM_LINES = 1024;
+		static const int STREAM_CONTEXT = 8;
+		static const int MAX_STREAM_LOOKAHEAD = 1024;
+		bool streamMode = false;
+		bool isStreaming = false;
+		bool isStreamWindow = false;
+		bool isStreamDone = false;
+		bool skipStreamLf = false;
+		size_t streamPos = 0;
+		long streamBytes = 0;
+		int windowStart = 0;
+		int coreBegin = 0;
+		int coreEnd = 0;
+		int currentRule = 0;
+		StreamState stream;
+		vector<LineList> streamErrors =
+			vector<LineList>(NUM_RULES, LineList(MAX_SHOWN));
+
+		// Batch settings & shared state
+		string metricsFile;
+		string profileFile;
+		string baselineFile;
+		string compiledProfileFile;
+		string fileListFile;
+		bool projectMode = false;
+		set<string> projectTypes;
+		bool diffMode = false;
+		bool gitDiffMode = false;
+		map<string, vector<int> > diffLines;
+		size_t projectTypesKey = 0;
+		unordered_set<size_t> baselineSpans;
+		unordered_set<size_t> starterSpans;
+		vector<size_t> lineHashes;
+		vector<int> baselineLines;
+
+		// Verdict memo & fingerprints
+		static const size_t MAX_MEMO_ENTRIES = 1 << 20;
+		unordered_map<size_t, unsigned> verdictMemo;
+		vector<unsigned> lineVerdicts;
+		vector<size_t> lineKeys;
+		vector<size_t> tokenHashes;
+		vector<size_t> gramHashes;
+		vector<size_t> fingerprints;
+		SimilarityIndex similarity;
+
+		// Summary, function cache, & other batch state
+		BatchSummary summary;
+		bool doSummary = false;
+		bool isJsonSummary = false;
+		string cacheFile;
+		static const size_t MAX_CACHED_FUNCTIONS = 1 << 16;
+		static const int MAX_CACHE_AGE = 8;
+		unordered_map<size_t, CachedFunction> functionCache;
+		string scratchToken;
+		string scratchName;
+		RuleProfile profile;
+		ScanMetrics metrics;
+		chrono::steady_clock::time_point stageStart;
+		long allocationMark = 0;
+		long batchMemoryBytes = 0;
+		long batchInputBytes = 0;
+		long maxFileMemoryBytes = 0;
+};
+
+// Enumeration for JSON value types
+enum JsonTypes {JSON_NULL = 0, JSON_BOOL, JSON_NUMBER, JSON_STRING,
+	JSON_ARRAY, JSON_OBJECT};
+
+// JsonValue class
+//   Minimal JSON reader, enough for Language Server Protocol messages.
+class JsonValue {
+	public:
+		bool parse(const string &text);
+		const JsonValue &get(const string &key) const;
+		const JsonValue &at(int index) const;
+		int size() const;
+		bool has(const string &key) const;
+		string asString() const;
+		int asInt() const;
+		string toJson() const;
+
+	private:
+		bool parseValue(const string &text, size_t &pos);
+		bool parseObject(const string &text, size_t &pos);
+		bool parseArray(const string &text, size_t &pos);
+		bool parseLiteral(const string &text, size_t &pos);
+		bool parseString(const string &text, size_t &pos, string &out);
+		bool parseEscape(const string &text, size_t &pos, string &out);
+		bool parseHex(const string &text, size_t pos, uint32_t &code);
+		void skipSpace(const string &text, size_t &pos);
+
+		// Member data
+		int type = JSON_NULL;
+		string value;
+		vector<string> keys;
+		vector<JsonValue> items;
+};
+
+// LspServer class
+//   Language Server Protocol mode over standard input & output.
+//   Keeps one scanner per open document, updated incrementally.
+class LspServer {
+	public:
+		LspServer(const StyleScanner &settings);
+		void run();
+
+	private:
+		bool readMessage(string &body);
+		bool readHeaders(long &length);
+		bool handleMessage(const JsonValue &message);
+		void openDocument(const JsonValue &params);
+		void changeDocument(const JsonValue &params);
+		void applyChange(StyleScanner &doc, const JsonValue &change);
+		vector<string> splitText(const string &text);
+		void setPositionEncoding(const JsonValue &params);
+		int getByteOffset(const string &line, int character);
+		int getCharLength(const string &line);
+		void closeDocument(const JsonValue &params);
+		void publishPending();
+		void reloadProfile();
+		void publishDiagnostics(const string &uri, StyleScanner &doc);
+		string getDiagnosticJson(StyleScanner &doc, int index);
+		void sendResult(const JsonValue &id, const string &result);
+		void sendError(const JsonValue &id, int code, const string &text);
+		void sendMessage(const string &body);
+
+		// Member data
+		StyleScanner prototype;
+		map<string, StyleScanner> documents;
+		set<string> pendingUris;
+		bool isUtf8Positions = false;
+};
+
+// FileWatcher class
+//   Watch mode: rescans files as they change (inotify, Linux only).
+//   Parent directories are watched, not the files themselves, so
+//   editors that save by renaming a new file are still seen.
+class FileWatcher {
+	public:
+		FileWatcher(StyleScanner &checker);
+		bool run();
+
+	private:
+		bool watchFiles();
+		bool addWatch(const string &path, bool isDirectory);
+		bool waitForChanges(set<string> &changed);
+		void readEvents(set<string> &changed);
+		bool isWatchedName(int watch, const string &name);
+
+		// Member data
+		static const int SETTLE_MS = 200;
+		StyleScanner &scanner;
+		int notifyFd = -1;
+		map<int, string> watchDirs;
+		map<int, set<string> > watchNames;
+		set<int> watchAll;
 };
 
 // Enumeration for comment types
@@ -153,6 +930,87 @@ const char C_COMMENT_START[] = {'/', '*', '\0'};
 const char C_COMMENT_END[] = {'*', '/', '\0'};
 const char DOUBLE_SLASH[] = {'/', '/', '\0'};
 const char START_BLOCK[] = {LEFT_BRACE};
+const char BYTE_ORDER_MARK[] = "\xEF\xBB\xBF";
+
+// Line-local rules: verdict depends only on a line & its verdict key
+const int LINE_RULES[] = {RULE_TAB_USAGE, RULE_LINE_LENGTH,
+	RULE_VARIABLE_NAMES, RULE_CONSTANT_NAMES, RULE_FUNCTION_NAMES,
+	RULE_PUNCTUATION_SPACING, RULE_SPACED_OPERATORS,
+	RULE_START_SPACE_COMMENTS, RULE_ENDLINE_COMMENTS};
+
+// Lines per hashed run for starter baseline matching
+const int BASELINE_SPAN = 3;
+
+// Fundamental type names
+const string BASIC_TYPES[] = {"int", "float", "double",
+	"char", "bool", "string", "void"};
+
+// Keywords kept as is in similarity fingerprints
+const string CPP_KEYWORDS[] = {"if", "else", "for", "while", "do",
+	"switch", "case", "default", "break", "continue", "return", "class",
+	"struct", "public", "private", "protected", "const", "static", "new",
+	"delete", "this", "true", "false", "nullptr", "using", "namespace",
+	"auto", "void", "int", "float", "double", "char", "bool", "string",
+	"long", "unsigned", "short", "sizeof", "template", "typename",
+	"virtual", "include", "cout", "cin", "endl", "vector"};
+
+// Similarity fingerprint settings
+//   Tokens per k-gram, k-grams per winnowing window, & fewest files
+//   a fingerprint must be in before it may count as boilerplate.
+const int K_GRAM = 8;
+const int WINNOW_WINDOW = 4;
+const int MIN_COMMON_FILES = 10;
+
+// Most files listed as worst in a batch summary
+const int MAX_WORST_FILES = 10;
+
+// DEFLATE code limits, length/distance tables (RFC 1951), & output
+// bytes reserved up front per input byte
+const int MAX_CODE_BITS = 15;
+const int MAX_LENGTH_CODES = 286;
+const int MAX_DISTANCE_CODES = 30;
+const int FIXED_LENGTH_CODES = 288;
+const size_t RESERVE_RATIO = 4;
+const short LENGTH_BASE[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19,
+	23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const short LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2,
+	2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const short DISTANCE_BASE[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49,
+	65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+	6145, 8193, 12289, 16385, 24577};
+const short DISTANCE_EXTRA[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5,
+	6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Tar archive block size
+const int TAR_BLOCK = 512;
+
+// Zip archive record sizes (central directory entry, local file
+// header, & end of central directory) & gzip header size, without
+// variable fields
+const size_t ZIP_ENTRY_SIZE = 46;
+const size_t ZIP_LOCAL_SIZE = 30;
+const size_t ZIP_END_SIZE = 22;
+const size_t GZIP_HEADER_SIZE = 10;
+
+// Compiled profile file magic & format version
+const char PROFILE_MAGIC[8] = {'S', 'S', 'P', 'R', 'O', 'F', '\0', '\0'};
+const uint32_t PROFILE_VERSION = 1;
+
+// First line of a function cache file (format version)
+const char FUNCTION_CACHE_HEADER[] = "StyleScanner function cache 2";
+
+// JSON output helpers
+string jsonQuote(const string &s);
+string jsonObject(const string &members);
+
+// String helpers
+bool endsWith(const string &s, const string &suffix);
+string shellQuote(const string &s);
+size_t getLittleEndian(const string &data, size_t pos, int numBytes);
+uint32_t getCrc32(const string &data);
+uint32_t getUtf16Unit(const string &data, size_t pos, bool isBigEndian);
+void appendUtf8(string &out, uint32_t code);
+string getTempName(const string &name);
 
 // Print program banner
 void StyleScanner::printBanner() {
@@ -163,33 +1021,91 @@ void StyleScanner::printBanner() {
 
 // Print program usage
 void StyleScanner::printUsage() {
-	cout << "Usage: StyleScanner file [options]\n";
+	cout << "Usage: StyleScanner file... [options]\n";
+	cout << "  where a file of - reads standard input\n";
+	cout << "  where a .tar, .tar.gz, or .zip file is scanned member by member\n";
+	cout << "  where a .gz or .zst file is decompressed as it is read\n";
 	cout << "  where options include:\n";
 	cout << "\t-fc suppress function comment check\n";
 	cout << "\t-fl suppress function length check\n";
-	cout << endl;
+	cout << "\t-m file write Prometheus metrics to file\n";
+	cout << "\t-p file load rule profile (reloaded on SIGHUP)\n";
+	cout << "\t-b file skip lines matching starter code file\n";
+	cout << "\t-c file cache per-function results in file\n";
+	printLongOptions();
+}
+
+// Print usage for long options
+void StyleScanner::printLongOptions() {
+	cout << "\t--compile-profile" << '=' << "out write -p & -b settings";
+	cout << " as binary profile (for -p)\n";
+	cout << "\t--mem-report report memory use per file & batch\n";
+	cout << "\t--lsp run as a language server on stdin/stdout\n";
+	cout << "\t--watch rescan files (or directories) when changed\n";
+	cout << "\t--memo reuse verdicts for lines seen before in batch\n";
+	cout << "\t--files0-from" << '=' << "F read NUL-separated file names";
+	cout << " from F (- for stdin)\n";
+	cout << "\t--diff[=git] report only lines added by a unified diff";
+	cout << " on stdin (or staged in git)\n";
+	cout << "\t--project check declarations of types from all headers";
+	cout << " in the batch\n";
+	cout << "\t--framed scan records from stdin: length, space, name,";
+	cout << " newline, content\n";
+	cout << "\t--summary[=json] print per-rule totals & worst files";
+	cout << " for the batch\n";
+	cout << "\t--similar[=N] report file pairs with N percent";
+	cout << " shared code (default 50)\n";
+	cout << "\t--stream scan each file through a window of lines,";
+	cout << " in bounded memory\n";
+	cout << "\n";
 }
 
 // Parse arguments
 void StyleScanner::parseArgs(int argc, char** argv) {
 	for (int count = 1; count < argc; count++) {
 		char *arg = argv[count];
-		if (arg[0] == '-') {
+		if (arg[0] == '-' && arg[1] != '\0') {
 			switch (arg[1]) {
 				case 'f': parseFunctionArg(arg); break;
+				case '-': parseLongArg(arg); break;
+				case 'm': metricsFile = getOptionValue(argc, argv, count); break;
+				case 'p': profileFile = getOptionValue(argc, argv, count); break;
+				case 'b': baselineFile = getOptionValue(argc, argv, count); break;
+				case 'c': cacheFile = getOptionValue(argc, argv, count); break;
 				default: exitAfterArgs = true;
 			}
 		}
-		else if (fileName == "") {
-			fileName = arg;
-		}
 		else {
-			exitAfterArgs = true;
+			fileNames.push_back(arg);
 		}
 	}
-	if (fileName == "") {
+	checkArgFiles();
+}
+
+// Check required files & load optional profile & baseline
+void StyleScanner::checkArgFiles() {
+	if (fileListFile != "" && !readFileList(fileListFile)) {
+		exitAfterArgs = true;
+	}
+	if (fileNames.empty() && !lspMode && !framedMode && !diffMode
+		&& compiledProfileFile.empty())
+	{
+		exitAfterArgs = true;
+	}
+	if (profileFile != "" && !loadProfile(profileFile)) {
 		exitAfterArgs = true;
 	}
+	if (baselineFile != "" && !loadBaseline(baselineFile)) {
+		exitAfterArgs = true;
+	}
+	if (streamMode && (!baselineSpans.empty() || diffMode
+		|| similarPercent > 0))
+	{
+		cerr << "Error: --stream cannot be used with -b, --diff,";
+		cerr << " or --similar.\n";
+		exitAfterArgs = true;
+	}
+	loadFunctionCache();
 }
 
 // Parse function-format arguments
@@ -203,6 +1119,109 @@ void StyleScanner::parseFunctionArg(char* arg) {
 	}
 }
 
+// Parse long-format arguments
+void StyleScanner::parseLongArg(char* arg) {
+	assert(arg[0] == '-' && arg[1] == '-');
+	if (strcmp(arg, "--mem-report") == 0) {
+		doMemoryReport = true;
+	}
+	else if (strcmp(arg, "--lsp") == 0) {
+		lspMode = true;
+	}
+	else if (strcmp(arg, "--watch") == 0) {
+		watchMode = true;
+	}
+	else if (strcmp(arg, "--memo") == 0) {
+		doMemo = true;
+	}
+	else if (strcmp(arg, "--project") == 0) {
+		projectMode = true;
+	}
+	else if (strcmp(arg, "--framed") == 0) {
+		framedMode = true;
+	}
+	else if (strcmp(arg, "--stream") == 0) {
+		streamMode = true;
+	}
+	else {
+		parseLongValueArg(arg);
+	}
+}
+
+// Parse long-format arguments that may take a value (after '=')
+void StyleScanner::parseLongValueArg(char* arg) {
+	if (strncmp(arg, "--files0-from=", 14) == 0) {
+		fileListFile = arg + 14;
+	}
+	else if (strncmp(arg, "--compile-profile=", 18) == 0) {
+		compiledProfileFile = arg + 18;
+	}
+	else if (strncmp(arg, "--similar", 9) == 0) {
+		similarPercent = arg[9] == '=' ? atoi(arg + 10) : 50;
+		if (similarPercent <= 0 || similarPercent > 100
+			|| (arg[9] != '=' && arg[9] != '\0'))
+		{
+			exitAfterArgs = true;
+		}
+	}
+	else {
+		parseLongModeArg(arg);
+	}
+}
+
+// Parse long-format mode arguments with an optional format or source
+void StyleScanner::parseLongModeArg(char* arg) {
+	if (strncmp(arg, "--summary", 9) == 0) {
+		doSummary = true;
+		isJsonSummary = arg[9] == '=' && strcmp(arg + 10, "json") == 0;
+		if (arg[9] != '\0' && !isJsonSummary) {
+			exitAfterArgs = true;
+		}
+	}
+	else if (strncmp(arg, "--diff", 6) == 0) {
+		diffMode = true;
+		gitDiffMode = arg[6] == '=' && strcmp(arg + 7, "git") == 0;
+		if (arg[6] != '\0' && !gitDiffMode) {
+			exitAfterArgs = true;
+		}
+	}
+	else {
+		exitAfterArgs = true;
+	}
+}
+
+// Get the value following an option argument
+//   Advances the argument index past the value.
+string StyleScanner::getOptionValue(int argc, char** argv, int &index) {
+	if (index + 1 < argc) {
+		index++;
+		return argv[index];
+	}
+	exitAfterArgs = true;
+	return "";
+}
+
+// Get number of files to scan
+int StyleScanner::getNumFiles() {
+	return getSize(fileNames);
+}
+
+// Reset per-file state to scan another file
+//   Containers are cleared, not freed, so capacity carries over.
+//   File lines & type names are kept as spares for reuse.
+void StyleScanner::reset() {
+	anyErrors = false;
+	fileName.clear();
+	fileText.clear();
+	resizeFileLines(0);
+	clearNewTypes();
+	commentLines.clear();
+	scopeLevels.clear();
+	braceLevels.clear();
+	newTypeLines.clear();
+	labelLevels.clear();
+}
+
 // Get exit after args flag
 bool StyleScanner::getExitAfterArgs() {
 	return exitAfterArgs;
@@ -211,1128 +1230,4961 @@ bool StyleScanner::getExitAfterArgs() {
 // Combined check-errors function
 //   Prioritized by importance
 void StyleScanner::checkErrors() {
+	diagnostics.clear();
+	anyErrors = false;
+	markBaselineLines();
+	memoLineVerdicts();
+	stageStart = chrono::steady_clock::now();
 	checkCriticalErrors();
 	checkReadabilityErrors();
 	checkDocumentationErrors();
 	checkNoErrors();
+	markStage(STAGE_CHECK);
+	metrics.recordAllocations(allocationCount - allocationMark);
 }
 
 // Check for critical errors
 void StyleScanner::checkCriticalErrors() {
-	checkAnyComments();
-	checkHeaderStart();
-	checkHeaderFormat();
-	checkFunctionLength();
+	if (startCheck(RULE_ANY_COMMENTS)) checkAnyComments();
+	if (startCheck(RULE_HEADER_START)) checkHeaderStart();
+	if (startCheck(RULE_HEADER_FORMAT)) checkHeaderFormat();
+	if (startCheck(RULE_FUNCTION_LENGTH)) checkFunctionLength();
 }
 
 // Check for readability errors
 void StyleScanner::checkReadabilityErrors() {
-	checkTabUsage();
-	checkIndentLevels();
-	checkLineLength();
-	checkVariableNames();
-	checkConstantNames();
-	checkFunctionNames();
-	checkClassNames();
-	checkExtraneousBlanks();
-	checkPunctuationSpacing();
-	checkSpacedOperators();
+	if (startCheck(RULE_TAB_USAGE)) checkTabUsage();
+	if (startCheck(RULE_INDENT_LEVELS)) checkIndentLevels();
+	if (startCheck(RULE_LINE_LENGTH)) checkLineLength();
+	if (startCheck(RULE_VARIABLE_NAMES)) checkVariableNames();
+	if (startCheck(RULE_CONSTANT_NAMES)) checkConstantNames();
+	if (startCheck(RULE_FUNCTION_NAMES)) checkFunctionNames();
+	if (startCheck(RULE_CLASS_NAMES)) checkClassNames();
+	if (startCheck(RULE_EXTRANEOUS_BLANKS)) checkExtraneousBlanks();
+	if (startCheck(RULE_PUNCTUATION_SPACING)) checkPunctuationSpacing();
+	if (startCheck(RULE_SPACED_OPERATORS)) checkSpacedOperators();
 }
 
 // Check for documentation errors
 void StyleScanner::checkDocumentationErrors() {
-	checkFunctionLeadComments();
-	checkBlanksBeforeComments();
-	checkTooFewComments();
-	checkTooManyComments();
-	checkStartSpaceComments();
-	checkEndlineComments();
-	checkEndlineRunonComments();
+	if (startCheck(RULE_FUNCTION_LEAD_COMMENTS)) checkFunctionLeadComments();
+	if (startCheck(RULE_BLANKS_BEFORE_COMMENTS)) checkBlanksBeforeComments();
+	if (startCheck(RULE_TOO_FEW_COMMENTS)) checkTooFewComments();
+	if (startCheck(RULE_TOO_MANY_COMMENTS)) checkTooManyComments();
+	if (startCheck(RULE_START_SPACE_COMMENTS)) checkStartSpaceComments();
+	if (startCheck(RULE_ENDLINE_COMMENTS)) checkEndlineComments();
+	if (startCheck(RULE_ENDLINE_RUNON_COMMENTS)) checkEndlineRunonComments();
+}
+
+// Is this rule enabled in the current profile?
+bool StyleScanner::isRuleOn(int rule) {
+	assert(0 <= rule && rule < NUM_RULES);
+	return profile.ruleEnabled[rule];
+}
+
+// Start a rule's check, if it is to run now
+//   In a window of a streamed file, whole-file rules are skipped;
+//   they are tracked as lines are read, & reported at the end.
+bool StyleScanner::startCheck(int rule) {
+	currentRule = rule;
+	return isRuleOn(rule) && !(isStreamWindow && isWholeFileRule(rule));
 }
 
-// Read a code file
-bool StyleScanner::readFile() {
+// Does this rule need the whole file (so can't check a window)?
+bool StyleScanner::isWholeFileRule(int rule) {
+	return rule == RULE_ANY_COMMENTS || rule == RULE_HEADER_START
+		|| rule == RULE_FUNCTION_LENGTH || rule == RULE_TOO_FEW_COMMENTS;
+}
+
+// Read a code file, by index in the file list
+//   Names each file in the report when scanning several.
+bool StyleScanner::readFile(int index) {
 
 	// Open the file
-	ifstream inFile(fileName);
-	if (!inFile) {
-		cerr << "Error: File not found.\n";
+	startFile(fileNames[index], getSize(fileNames) > 1 || watchMode);
+
+	// Read & split the file
+	//   Name "-" reads standard input, e.g., from a pipe.
+	bool isRead = readNamedText();
+	if (!isRead) {
+		printReadError();
 		return false;
 	}
+	return loadReadText();
+}
 
-	// Read the file
-	string nextLine;
-	while (!inFile.eof()) {
-		getline(inFile, nextLine);
-		fileLines.push_back(nextLine);
-	}
-	inFile.close();
+// Report a file that cannot be read
+void StyleScanner::printReadError() {
+	cerr << (isDirectory(fileName) ? "Error: Cannot read a directory.\n"
+		: "Error: File not found.\n");
+	metrics.recordFailure();
+}
 
-	// Post-processing
-	scanCommentLines();
-	scanNewTypeDefs();
-	scanScopeLevels();
-	scanScopeLabels();
+// Decompress & split the text read for a file
+//   Returns false if it cannot be decompressed, or was an archive on
+//   standard input (so its members were scanned instead).
+bool StyleScanner::loadReadText() {
+	if (isGzipData(fileText) && !inflateGzipText()) {
+		cerr << "Error: Cannot decompress file.\n";
+		metrics.recordFailure();
+		return false;
+	}
+	if (fileName == "-" && scanInputArchive()) {
+		return false;
+	}
+	loadFileText();
 	return true;
 }
 
-// Print the read file (for testing)
-void StyleScanner::writeFile() {
-	for (string line: fileLines) {
-		cout << line << endl;
+// Start timing (& naming, if shown) a file or archive member
+void StyleScanner::startFile(const string &name, bool showName) {
+	stageStart = chrono::steady_clock::now();
+	allocationMark = allocationCount;
+	fileName = name;
+	if (showName) {
+		cout << "\n" << fileName << ":\n";
 	}
-	cout << endl;
 }
 
-// Get integer-length of a string
-//   (Silences compiler warnings on conversion.)
-int StyleScanner::getLength(const string &line) {
-	return (int) line.length();	
+// Split, record, & prescan the text read for a file
+void StyleScanner::loadFileText() {
+	splitFileLines();
+	metrics.recordFile(getLength(fileText), getSize(fileLines));
+	markStage(STAGE_READ);
+	prescanFile();
 }
 
-// Get integer-size of a vector of strings
-//   (Silences compiler warnings on conversion.)
-int StyleScanner::getSize(const vector<string> &vec) {
-	return (int) vec.size();	
+// Scan one file & report, reusing state from any prior scan
+//   A tar or zip archive is scanned member by member.
+void StyleScanner::scanFile(int index) {
+	reset();
+	if (isTarName(fileNames[index])) {
+		scanTarFile(fileNames[index]);
+	}
+	else if (isZipName(fileNames[index])) {
+		scanZipFile(fileNames[index]);
+	}
+	else if (streamMode && !endsWith(fileNames[index], ".zst")) {
+		scanStreamFile(index);
+	}
+	else if (readFile(index)) {
+		checkLoadedFile();
+	}
+	writeMetrics();
+	cout.flush();
 }
 
-// Get integer-size of a vector of ints
-//   (Silences compiler warnings on conversion.)
-int StyleScanner::getSize(const vector<int> &vec) {
-	return (int) vec.size();	
+// Scan the batch of files (or framed records) & finish reporting
+//   Returns false if framed input is malformed.
+bool StyleScanner::scanBatch() {
+	bool isOk = true;
+	if (diffMode) {
+		isOk = loadDiffFiles();
+	}
+	if (projectMode) {
+		loadProjectTypes();
+	}
+	if (framedMode) {
+		isOk = scanFramedInput();
+	}
+	for (int i = 0; i < getSize(fileNames); i++) {
+		scanFile(i);
+	}
+	finishBatch();
+	return isOk;
 }
 
-// Get first nonspace position in a string
-//   Returns -1 if none such.
-int StyleScanner::getFirstNonspacePos(const string &line) {
-	for (int i = 0; i < getLength(line); i++) {
-		if (!isspace(line[i])) {
-			return i;
+// Build the shared project type table from the batch's headers
+//   Headers are prescanned for class & struct names before any file
+//   is checked, so every file sees the types of all the headers.
+void StyleScanner::loadProjectTypes() {
+	for (const string &name: fileNames) {
+		if (!endsWith(name, ".h") && !endsWith(name, ".hpp")) {
+			continue;
+		}
+		reset();
+		fileName = name;
+		if (readFileText()) {
+			splitFileLines();
+			scanCommentLines();
+			scanNewTypeDefs();
+			projectTypes.insert(newTypes.begin(), newTypes.end());
 		}
 	}
-	return -1;
+	reset();
+	for (const string &type: projectTypes) {
+		projectTypesKey = projectTypesKey * 31
+			+ getTextHash(type, 0, getLength(type));
+	}
 }
 
-// Get last nonspace position in a string
-//   Returns -1 if none such.
-int StyleScanner::getLastNonspacePos(const string &line) {
-	for (int i = getLength(line) - 1; i >= 0; i--) {
-		if (!isspace(line[i])) {
-			return i;
+// Read file names from a list file (- for standard input)
+//   Names are separated by NUL characters, as from find -print0.
+bool StyleScanner::readFileList(const string &name) {
+	ifstream inFile;
+	if (name != "-") {
+		inFile.open(name);
+		if (!inFile) {
+			cerr << "Error: File list not found.\n";
+			return false;
 		}
 	}
-	return -1;
-}
-
-// Is this line a blank (all whitespace)?
-bool StyleScanner::isBlank(const string &line) {
-	return getFirstNonspacePos(line) == -1;
+	istream &in = name == "-" ? cin : inFile;
+	string listName;
+	while (getline(in, listName, '\0')) {
+		if (!listName.empty()) {
+			fileNames.push_back(listName);
+		}
+	}
+	return true;
 }
 
-// Is this line number a blank?
-bool StyleScanner::isBlank(int line) {
-	return isBlank(fileLines[line]);
+// Scan framed file records from standard input
+//   Each record is a header line of a length & a name, separated by
+//   a space, then that many bytes of content; the file system is not
+//   used. Each report is flushed as its record finishes. A bad
+//   header (or one over MAX_RECORD_SIZE) is reported & skipped, so
+//   reading resumes at the next line.
+bool StyleScanner::scanFramedInput() {
+	const long MAX_RECORD_SIZE = 1L << 30;
+	bool isOk = true;
+	string header;
+	while (getline(cin, header)) {
+		char *end = nullptr;
+		long size = strtol(header.c_str(), &end, 10);
+		if (end == header.c_str() || *end != ' ' || size < 0
+			|| size > MAX_RECORD_SIZE)
+		{
+			cerr << "Error: Bad framed record header.\n";
+			isOk = false;
+			continue;
+		}
+		if (!scanStreamMember(cin, end + 1, size)) {
+			cerr << "Error: Input is truncated.\n";
+			return false;
+		}
+		writeMetrics();
+		cout.flush();
+	}
+	return isOk;
 }
 
-// Is this line solely a left-brace?
-bool StyleScanner::isLeftBrace(int line) {
-	int startPos = getFirstNonspacePos(fileLines[line]);
-	int endPos = getLastNonspacePos(fileLines[line]);
-	return startPos != -1
-		&& startPos == endPos
-		&& fileLines[line][startPos] == LEFT_BRACE;
+// Check & report a loaded file
+void StyleScanner::checkLoadedFile() {
+	reloadProfileIfRequested();
+	checkErrors();
+	if (doSummary) {
+		summary.endFile(fileName);
+	}
+	if (similarPercent > 0) {
+		fingerprintFile();
+	}
+	printMemoryReport();
 }
 
-// Is this line either blank or a left-brace?
-bool StyleScanner::isBlankOrBrace(int line) {
-	return isBlank(line) || isLeftBrace(line);	
+// Scan a file as a stream, through a window of lines
+//   Memory use is bounded by the window, not the file size. Text
+//   that must be decoded whole (gzip, UTF-16, or an archive on
+//   standard input) is read whole & scanned as usual.
+//   Unlike a whole-file scan, a type declared later in the file is
+//   not yet known to earlier windows, & checks after a comment block
+//   longer than the lookahead see only its start.
+void StyleScanner::scanStreamFile(int index) {
+	startFile(fileNames[index], getSize(fileNames) > 1 || watchMode);
+	ifstream inFile;
+	inFile.rdbuf()->pubsetbuf(readBuffer, sizeof readBuffer);
+	if (!openStreamFile(inFile)) {
+		return;
+	}
+	istream &in = fileName == "-" ? cin : static_cast<istream&>(inFile);
+	reloadProfileIfRequested();
+	isStreamDone = false;
+	skipStreamLf = false;
+	streamBytes = 0;
+	readStreamBlock(in);
+	if (isStreamableText()) {
+		scanStreamLines(in);
+	}
+	else if (appendStreamText(in) && loadReadText()) {
+		checkLoadedFile();
+	}
 }
 
-// Does string s start with string t?
-bool StyleScanner::stringStartsWith(const string &s, const string &t) {
-	return s.rfind(t, 0) == 0;
+// Open the current file to scan as a stream
+//   Returns false (once reported) if it cannot be read.
+bool StyleScanner::openStreamFile(ifstream &inFile) {
+	if (fileName == "-") {
+		return true;
+	}
+	if (!isDirectory(fileName)) {
+		inFile.open(fileName);
+	}
+	if (!inFile.is_open()) {
+		printReadError();
+		return false;
+	}
+	return true;
 }
 
-// Does string s end with string t?
-bool StyleScanner::stringEndsWith(const string &s, const string &t) {
-	return s.find(t, s.length() - t.length()) != string::npos;
+// Can the text read so far be scanned as a stream?
+bool StyleScanner::isStreamableText() {
+	return !isGzipData(fileText) && !isUtf16Text() && !(fileName == "-"
+		&& (isTarData(fileText) || isZipData(fileText)));
 }
 
-// Find where the comment lines are
-//    Assumes comments are full lines (no endline comments, etc.)
-void StyleScanner::scanCommentLines() {
-	commentLines.resize(getSize(fileLines));
-	bool inCstyleComment = false;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		string firstToken = getFirstToken(fileLines[i]);
-		string lastToken = getLastToken(fileLines[i]);
-
-		// Check C-style comment
-		if (stringStartsWith(firstToken, C_COMMENT_START)) {
-			inCstyleComment = true;
-		}
-		if (inCstyleComment) {
-			commentLines[i] = C_COMMENT;
-		}
-		if (stringEndsWith(lastToken, C_COMMENT_END)) {
-			inCstyleComment = false;
-		}
+// Scan the lines of a stream, a window at a time, & report
+//   Each window checks its core lines, with context lines on either
+//   side, then slides on to keep the last context as its start.
+void StyleScanner::scanStreamLines(istream &in) {
+	startStream();
+	while (fillStreamWindow(in)) {
+		checkStreamWindow();
+		slideStreamWindow();
+	}
+	checkStreamWindow();
+	finishStream();
+	if (doSummary) {
+		summary.endFile(fileName);
+	}
+	printMemoryReport();
+	isStreaming = false;
+	errorLines = LineList(MAX_SHOWN);
+}
 
-		// Check C++-style comment
-		if (stringStartsWith(firstToken, DOUBLE_SLASH)) {
-			commentLines[i] = CPP_COMMENT;
-		}
+// Start the window & whole-file rule state for a streamed file
+//   Error lines are uncapped while kept, since only a window's core
+//   lines are kept, & a cap would drop later windows' errors.
+void StyleScanner::startStream() {
+	if (fileText.compare(0, 3, BYTE_ORDER_MARK) == 0) {
+		streamPos = 3;
 	}
+	stream = StreamState();
+	for (LineList &lines: streamErrors) {
+		lines.clear();
+	}
+	errorLines = LineList();
+	lineVerdicts.clear();
+	isStreaming = true;
+	windowStart = 0;
+	coreBegin = 0;
+	stageStart = chrono::steady_clock::now();
 }
 
-// Is the line a (full-line) comment?
-bool StyleScanner::isCommentLine(int line) {
-	assert(0 <= line && line < getSize(fileLines));
-	return (bool) commentLines[line];
+// Read the next block of a streamed file into the file buffer
+//   A line feed at its start is skipped if the block before ended
+//   in a carriage return, so a split CRLF ends just one line.
+//   Returns false at the end of input.
+bool StyleScanner::readStreamBlock(istream &in) {
+	const int BLOCK_SIZE = 65536;
+	fileText.resize(BLOCK_SIZE);
+	in.read(&fileText[0], BLOCK_SIZE);
+	fileText.resize((size_t) in.gcount());
+	streamBytes += getLength(fileText);
+	streamPos = skipStreamLf && !fileText.empty() && fileText[0] == '\n';
+	skipStreamLf = false;
+	return !fileText.empty();
 }
 
-// Is the line a comment before a case or default label?
-bool StyleScanner::isCommentBeforeCase(int line) {
-	assert(0 <= line && line < getSize(fileLines));
-	if (isCommentLine(line)) {
-		for (int cLine = line + 1; cLine < getSize(fileLines); cLine++) {
-			if (isCommentLine(cLine)) continue;
-			string firstToken = getFirstToken(fileLines[cLine]);
-			if (firstToken == "case" || firstToken == "default")
-				return true;
-			else
-				return false;
+// Read the next line of a streamed file
+//   Lines end in LF, CRLF, or a lone CR, as when split whole; a final
+//   line end gives a last empty line. Very long lines keep only
+//   their start. Returns false once past the last line.
+bool StyleScanner::readStreamLine(istream &in, string &line) {
+	const size_t MAX_LINE_BYTES = 1 << 20;
+	line.clear();
+	while (!isStreamDone) {
+		if (streamPos >= fileText.size() && !readStreamBlock(in)) {
+			isStreamDone = true;
+			return true;
+		}
+		size_t end = fileText.find_first_of("\r\n", streamPos);
+		size_t stop = min(end, fileText.size());
+		size_t room = MAX_LINE_BYTES - min(line.size(), MAX_LINE_BYTES);
+		line.append(fileText, streamPos, min(stop - streamPos, room));
+		streamPos = stop;
+		if (end != string::npos) {
+			skipStreamLineEnd(end);
+			return true;
 		}
 	}
 	return false;
 }
 
-// Does this line start with an opening brace?
-bool StyleScanner::isLineStartOpenBrace(const string &line) {
-	int firstPos = getFirstNonspacePos(line);
-	return firstPos >= 0 && line[firstPos] == LEFT_BRACE;
+// Move past a line end in a streamed file
+//   A carriage return at the end of a block may start a CRLF split
+//   across blocks, so a line feed next is skipped.
+void StyleScanner::skipStreamLineEnd(size_t end) {
+	bool isCr = fileText[end] == '\r';
+	streamPos = end + 1;
+	if (isCr && streamPos == fileText.size()) {
+		skipStreamLf = true;
+	}
+	else if (isCr && fileText[streamPos] == '\n') {
+		streamPos++;
+	}
 }
 
-// Does this line start with a closing brace?
-bool StyleScanner::isLineStartCloseBrace(const string &line) {
-	int firstPos = getFirstNonspacePos(line);
-	return firstPos >= 0 && line[firstPos] == RIGHT_BRACE;
+// Fill the stream window with core lines & the context after them
+//   Context runs on through a comment block (to a limit), for
+//   checks of what follows a comment. Returns false at the end
+//   of input, when the core then runs to the last line.
+bool StyleScanner::fillStreamWindow(istream &in) {
+	coreEnd = coreBegin + STREAM_LINES;
+	while (getSize(fileLines) < coreEnd + STREAM_CONTEXT
+		|| (commentLines.back()
+			&& getSize(fileLines) < coreEnd + MAX_STREAM_LOOKAHEAD))
+	{
+		if (!addStreamLine(in)) {
+			coreEnd = INT_MAX;
+			return false;
+		}
+	}
+	return true;
 }
 
-// Does this line start with a label of interest?
-bool StyleScanner::isLineLabel(const string &line) {
-	const string LABELS[] = {"case", "default",
-		"public", "private", "protected"};
-	string firstToken = getFirstToken(line);
-	for (string label: LABELS) {
-		if (firstToken == label) {
-			return true;
-		}
+// Read & prescan one more line into the stream window
+//   Line strings are reused from lines slid out of the window.
+//   Returns false at the end of input.
+bool StyleScanner::addStreamLine(istream &in) {
+	int line = getSize(fileLines);
+	resizeFileLines(line + 1);
+	if (!readStreamLine(in, fileLines[line])) {
+		resizeFileLines(line);
+		return false;
 	}
-	return false;
+	prescanStreamLine(line);
+	return true;
 }
 
-// Does this line end with a semicolon?
-bool StyleScanner::isLineEndingSemicolon(const string &line) {
-	int lastPos = getLastNonspacePos(line);
-	return lastPos != -1 && line[lastPos] == SEMICOLON;
+// Prescan a line added to the stream window
+//   Comment, brace, & label state carry on from the line before,
+//   as do the whole-file rules tracked along the stream.
+void StyleScanner::prescanStreamLine(int i) {
+	commentLines.push_back(NO_COMMENT);
+	braceLevels.push_back(0);
+	scopeLevels.push_back(0);
+	stream.inCstyleComment = scanCommentLine(i, stream.inCstyleComment);
+	scanNewTypeDef(i);
+	stream.braceLevel = scanBraceLevels(i, i + 1, stream.braceLevel);
+	setScopeLevel(i);
+	stream.labelLevel = scanScopeLabel(i, stream.labelLevel);
+	trackStreamComments(i);
+	trackStreamFunctions(i);
 }
 
-// Scan for new type names
-//   Note currently just class/structs
-//   (not actual "typedef" statements)
-void StyleScanner::scanNewTypeDefs() {
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			int pos = 0;
-			string line = fileLines[i];
-			string prefix = getNextToken(line, pos);
-			if (isClassKeyword(prefix)) {
-				string name = getNextToken(line, pos);
-				newTypes.push_back(name);
-			}
-		}
+// Track the first comment & uncommented stretches along a stream
+//   Matches checkTooFewComments(): a stretch starts at a comment,
+//   & the search for the next resumes two lines past its end.
+void StyleScanner::trackStreamComments(int i) {
+	int line = windowStart + i;
+	if (!commentLines[i]) {
+		return;
+	}
+	if (stream.firstComment < 0) {
+		stream.firstComment = line;
+	}
+	if (stream.gapStart < 0 && line >= stream.gapSearch) {
+		stream.gapStart = line;
+	}
+	else if (stream.gapStart >= 0) {
+		flagStreamGap(line - stream.gapStart - 1);
+		stream.gapSearch = line + 2;
+		stream.gapStart = -1;
 	}
 }
 
-// Basic scan for scope level at each line
-//   Increments/decrements at each brace
-void StyleScanner::scanScopeLevels() {
-	scopeLevels.resize(getSize(fileLines));
-	int scopeLevel = 0;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		scopeLevels[i] = scopeLevel;
-		if (!commentLines[i]) {
-			string line = fileLines[i];
-			for (int i = 0; i < getLength(line); i++) {
-				switch (line[i]) {
-					case LEFT_BRACE: scopeLevel++; break;
-					case RIGHT_BRACE: scopeLevel--; break;
-				}
-			}
-			
-			// Adjust current line back for first closure
-			if (isLineStartCloseBrace(line)) {
-				scopeLevels[i]--;
-			}
+// Keep a "too few comments" error for a stretch, if too long
+void StyleScanner::flagStreamGap(int span) {
+	const int LONG_STRETCH = profile.maxUncommentedLines;
+	if (span > LONG_STRETCH) {
+		streamErrors[RULE_TOO_FEW_COMMENTS].add(
+			stream.gapStart + LONG_STRETCH / 2);
+	}
+}
+
+// Track function lengths along a stream
+//   Matches countFunctionLength(): a function ends at the first line
+//   neither starting with a brace nor deeper than its header.
+void StyleScanner::trackStreamFunctions(int i) {
+	for (OpenFunction &function: stream.functions) {
+		if (function.length < 0 && !isLineStartOpenBrace(fileLines[i])
+			&& scopeLevels[i] <= function.scope)
+		{
+			function.length = windowStart + i - function.start - 1;
 		}
 	}
+	if (scopeLevels[i] == 0) {
+		stream.inClassHeader = false;
+	}
+	if (!commentLines[i] && isClassHeader(fileLines[i])) {
+		stream.inClassHeader = true;
+	}
+	if (!commentLines[i] && isFunctionHeader(fileLines[i])) {
+		stream.functions.push_back({windowStart + i, scopeLevels[i],
+			getFunctionLengthLimit(stream.inClassHeader), -1});
+	}
+	flushStreamFunctions(-1);
 }
 
-// Increment scope levels within labels
-//   Assumes basic scope levels set first
-//   Note labels only legitmate at scope level 1+.
-void StyleScanner::scanScopeLabels() {
-	int labelLevel = 0;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		bool thisLineLabel = !commentLines[i] 
-			&& isLineLabel(fileLines[i]);
-		if (!labelLevel) {
-			if (thisLineLabel) {
-				labelLevel = scopeLevels[i];		
-			}
+// Keep errors for measured functions, in header order
+//   At the end of the file (numLines >= 0), all functions are ended.
+void StyleScanner::flushStreamFunctions(int numLines) {
+	int numDone = 0;
+	for (OpenFunction &function: stream.functions) {
+		if (function.length < 0 && numLines >= 0) {
+			function.length = numLines - function.start - 1;
 		}
-		else {
-			if (scopeLevels[i] < labelLevel) {
-				labelLevel = 0;
-			}
-			else if (!thisLineLabel) {
-				scopeLevels[i]++;
-			}
+		if (function.length < 0) {
+			break;
 		}
+		if (function.length > function.limit) {
+			streamErrors[RULE_FUNCTION_LENGTH].add(function.start);
+		}
+		numDone++;
 	}
+	stream.functions.erase(stream.functions.begin(),
+		stream.functions.begin() + numDone);
 }
 
-// Print basic error
-void StyleScanner::printError(const string &error) {
-	cout << error << "\n";
+// Check the lines in the stream window
+//   Errors are kept only for core lines; context lines are checked
+//   as core in the window before or after.
+void StyleScanner::checkStreamWindow() {
+	isStreamWindow = true;
+	checkCriticalErrors();
+	checkReadabilityErrors();
+	checkDocumentationErrors();
+	isStreamWindow = false;
 }
 
-// Format an error report with line numbers
-//   If lines vector is empty, then nothing is printed.
-//   Line numbers are incremented for user display.
-void StyleScanner::printErrors(const string &error, const vector<int> &lines) {
-
-	// Flag any errors
-	if (lines.size() > 0) {
-		anyErrors = true;	
-	}
+// Slide the stream window past its core lines
+//   The context before the next core stays, & the strings of lines
+//   dropped are kept as spares for the lines read next.
+void StyleScanner::slideStreamWindow() {
+	int drop = coreEnd - STREAM_CONTEXT;
+	rotate(fileLines.begin(), fileLines.begin() + drop, fileLines.end());
+	resizeFileLines(getSize(fileLines) - drop);
+	commentLines.erase(commentLines.begin(), commentLines.begin() + drop);
+	braceLevels.erase(braceLevels.begin(), braceLevels.begin() + drop);
+	scopeLevels.erase(scopeLevels.begin(), scopeLevels.begin() + drop);
+	windowStart += drop;
+	coreBegin = STREAM_CONTEXT;
+}
 
-	// Singular error
-	if (lines.size() == 1) {
-		cout << error << " (line " << lines[0] + 1 << ").\n";
+// Keep a window check's errors on core lines, by file line number
+//   Each rule's list is capped as for printing, so only counts grow.
+//   Returns false when reporting instead, having taken those kept.
+bool StyleScanner::keepStreamErrors() {
+	LineList &kept = streamErrors[currentRule];
+	if (!isStreamWindow) {
+		errorLines = kept;
+		return false;
 	}
-
-	// Multiple errors
-	else if (lines.size() > 1) {
-		const int MAX_SHOWN = 3;
-		cout << error << " (lines " << lines[0] + 1;
-		for (int i = 1; i < getSize(lines) && i < MAX_SHOWN; i++) {
-			cout << ", " << lines[i] + 1;
+	for (int run = 0; run < errorLines.getNumRuns(); run++) {
+		int first = max(errorLines.getRunFirst(run), coreBegin);
+		int last = min(errorLines.getRunLast(run), coreEnd - 1);
+		for (int line = first; line <= last; line++) {
+			kept.add(windowStart + line);
 		}
-		if (lines.size() > MAX_SHOWN) {
-			cout << ", etc";
-		}
-		cout << ").\n";
 	}
+	errorLines.clear();
+	return true;
 }
 
-// Print success message if no errors found.
-void StyleScanner::checkNoErrors() {
-	if (!anyErrors) {
-		cout << "No errors found.\n";	
+// Finish a streamed file: end whole-file rules, then report
+//   Reports run the usual checks on an empty window, which print the
+//   errors kept for each rule, in the usual order.
+void StyleScanner::finishStream() {
+	int numLines = windowStart + getSize(fileLines);
+	if (stream.gapStart >= 0) {
+		flagStreamGap(numLines - stream.gapStart - 2);
 	}
+	flushStreamFunctions(numLines);
+	metrics.recordFile(streamBytes, numLines);
+	resizeFileLines(0);
+	commentLines.clear();
+	braceLevels.clear();
+	scopeLevels.clear();
+	windowStart = 0;
+	checkCriticalErrors();
+	checkReadabilityErrors();
+	checkDocumentationErrors();
+	checkNoErrors();
+	markStage(STAGE_CHECK);
+	metrics.recordAllocations(allocationCount - allocationMark);
 }
 
-// Get index of first comment line
-//   Returns -1 if none whatsoever
-int StyleScanner::getFirstCommentLine() {
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (commentLines[i]) {
-			return i;
-		}
+// Is this a tar archive name (possibly gzipped)?
+bool StyleScanner::isTarName(const string &name) {
+	return endsWith(name, ".tar") || endsWith(name, ".tar.gz")
+		|| endsWith(name, ".tgz");
+}
+
+// Does this text start with a (POSIX ustar) tar header?
+bool StyleScanner::isTarData(const string &text) {
+	return text.size() >= TAR_BLOCK && text.compare(257, 5, "ustar") == 0;
+}
+
+// Scan a tar archive file, streaming members from it
+//   A gzipped archive is read through a gzip process, which runs
+//   ahead decompressing later members while earlier ones are scanned.
+void StyleScanner::scanTarFile(const string &name) {
+	if (!ifstream(name)) {
+		cerr << "Error: File not found.\n";
+		metrics.recordFailure();
+	}
+	else if (endsWith(name, ".tar")) {
+		ifstream inFile(name, ios::binary);
+		scanTarStream(inFile, name);
+	}
+	else {
+		scanGzipTarFile(name);
 	}
-	return -1;
 }
 
-// Check if the file has any comment lines at all
-void StyleScanner::checkAnyComments() {
-	if (getFirstCommentLine() == -1) {
-		printError("No comments found!");
+// Scan a gzipped tar archive through a gzip process
+void StyleScanner::scanGzipTarFile(const string &name) {
+	#ifdef __unix__
+	FILE *pipe = popen(("gzip -dc < " + shellQuote(name)).c_str(), "r");
+	if (pipe == nullptr) {
+		cerr << "Error: Cannot run gzip.\n";
+		metrics.recordFailure();
+		return;
 	}
+	PipeBuf pipeBuf(pipe);
+	istream inPipe(&pipeBuf);
+	scanTarStream(inPipe, name);
+	pclose(pipe);
+	#else
+	cerr << "Error: Gzipped archives need gzip (unix only).\n";
+	#endif
 }
 
-// Check header start
-//   File should start with a comment
-void StyleScanner::checkHeaderStart() {
-	if (getFirstCommentLine() != 0) {
-		printError("No comment on first line! (line 1).");
+// Scan standard input as an archive, if it holds one
+//   Standard input is only known to be an archive once read.
+bool StyleScanner::scanInputArchive() {
+	if (isTarData(fileText)) {
+		scanTarText();
+	}
+	else if (isZipData(fileText)) {
+		scanZipText();
 	}
+	else {
+		return false;
+	}
+	return true;
 }
 
-// Check file header
-void StyleScanner::checkHeaderFormat() {
-	vector<int> errorLines;
-	const string HEADER[] = {C_COMMENT_START, "Name:", "Copyright:",
-		"Author:", "Date:", "Description:"};
-	int currLine = getFirstCommentLine();
-	if (currLine >= 0) {
-		for (string headPrefix: HEADER) {
-			if (currLine >= getSize(fileLines)) {
-				errorLines.push_back(currLine);
-			}
-			else {
-				string thisLine = fileLines[currLine];
-				unsigned int startIdx = getFirstNonspacePos(thisLine);
-				if (thisLine.find(headPrefix, startIdx) != startIdx) {
-					errorLines.push_back(currLine);
-				}
+// Scan a tar archive read whole from standard input
+void StyleScanner::scanTarText() {
+	archiveText.swap(fileText);
+	MemoryBuf memoryBuf(&archiveText[0], archiveText.size());
+	istream inText(&memoryBuf);
+	string archiveName = fileName;
+	scanTarStream(inText, archiveName);
+	archiveText.clear();
+}
+
+// Scan each source file member of a tar stream
+//   Handles ustar name prefixes, GNU long names, & pax paths; other
+//   entries (directories, links, global pax headers) are skipped.
+//   An archive should end in a zero block; reaching end of input
+//   first means truncation.
+void StyleScanner::scanTarStream(istream &in, const string &archiveName) {
+	char header[TAR_BLOCK];
+	string longName;
+	while (in.read(header, TAR_BLOCK) && header[0] != '\0') {
+		long size = strtol(string(header + 124, 12).c_str(), nullptr, 8);
+		long padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+		string name = longName.empty() ? getTarName(header) : longName;
+		longName.clear();
+
+		// Keep a long name (GNU or pax) for the next entry; scan sources
+		if (header[156] == 'L' || header[156] == 'x') {
+			readTarLongName(in, size, longName, header[156] == 'x');
+		}
+		else if (isTarSourceEntry(header, name)) {
+			if (!scanStreamMember(in, archiveName + ":" + name, size)) {
+				break;
 			}
-			currLine++;
 		}
+		else {
+			in.ignore(size);
+		}
+		in.ignore(padding);
+	}
+	if (!in) {
+		cerr << "Error: Archive is truncated.\n";
 	}
-	printErrors("Invalid comment header!", errorLines);
 }
 
-// Check line lengths
-void StyleScanner::checkLineLength() {
-	const int MAX_LENGTH = 80;
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (fileLines[i].length() > MAX_LENGTH) {
-			errorLines.push_back(i);
-		}
+// Read a long name entry's data (the next entry's path)
+//   A pax extended header holds it in a record, among others.
+void StyleScanner::readTarLongName(istream &in, long size, string &name,
+	bool isPax)
+{
+	if (isPax) {
+		return readTarPaxName(in, size, name);
 	}
-	printErrors("Line is too long", errorLines);
+	const long MAX_NAME = 4096;
+	long length = max(0L, min(size, MAX_NAME));
+	name.resize(length);
+	in.read(&name[0], length);
+	in.ignore(size - length);
+	name.resize(strnlen(name.c_str(), length));
 }
 
-// How many tabs are at the start of this line?
-int StyleScanner::getStartTabCount(const string &line) {
-	int count = 0;
-	while (count < getLength(line) && line[count] == '\t')
-		count++;
-	return count;
+// Read a pax extended header's data (the next entry's attributes),
+// keeping any path it gives
+void StyleScanner::readTarPaxName(istream &in, long size, string &name) {
+	const long MAX_HEADER = 65536;
+	long length = max(0L, min(size, MAX_HEADER));
+	string records(length, '\0');
+	in.read(&records[0], length);
+	records.resize((size_t) in.gcount());
+	in.ignore(size - length);
+	size_t pos = 0;
+	while (pos < records.size() && parsePaxRecord(records, pos, name));
 }
 
-// Is the indent in this line using tabs?
-bool StyleScanner::isIndentTabs(int line) {
-	string lineStr = fileLines[line];	
-	int checkToPos = getFirstNonspacePos(lineStr);
-
-	// Artistic Style uses spaces for continuation lines;
-	// so in these cases, check no further than scope level
-	if (mayBeRunOnLine(line)) {
-		checkToPos = min(checkToPos, scopeLevels[line]);
+// Parse one pax record at pos, keeping its value if it is the path
+//   Records are a length (of the whole record), a space, & then
+//   key '=' value, ending in a newline. Advances pos past it.
+//   Returns false if the record is malformed.
+bool StyleScanner::parsePaxRecord(const string &text,
+	size_t &pos, string &path)
+{
+	long length = strtol(text.c_str() + pos, nullptr, 10);
+	size_t space = text.find(' ', pos);
+	size_t equals = text.find('=', pos);
+	if (length <= 0 || (size_t) length > text.size() - pos
+		|| equals >= pos + length - 1 || space >= equals)
+	{
+		return false;
 	}
-	
-	// Check for all-tabs here
-	for (int i = 0; i < checkToPos; i++) {
-		if (lineStr[i] != '\t') {
-			return false;
-		}
+	size_t end = pos + length - 1;
+	if (text.compare(space + 1, equals - space - 1, "path") == 0) {
+		path.assign(text, equals + 1, end - equals - 1);
 	}
+	pos = end + 1;
 	return true;
 }
 
-// Check endline comments
-void StyleScanner::checkEndlineComments() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!commentLines[i]
-			&& (fileLines[i].find(DOUBLE_SLASH) != string::npos
-			|| fileLines[i].find(C_COMMENT_START) != string::npos))
-		{
-			errorLines.push_back(i);
-		}
+// Is this tar entry a regular file with a source file name?
+bool StyleScanner::isTarSourceEntry(const char *header, const string &name) {
+	return (header[156] == '0' || header[156] == '\0') && isSourceName(name);
+}
+
+// Get a member's path from its tar header (prefix, then name)
+string StyleScanner::getTarName(const char *header) {
+	string name(header + 345, strnlen(header + 345, 155));
+	if (!name.empty()) {
+		name += "/";
 	}
-	printErrors("Endline comments should not be used", errorLines);
+	return name.append(header, strnlen(header, 100));
 }
 
-// Check tab usage for indents
-void StyleScanner::checkTabUsage() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isIndentTabs(i)) {
-			errorLines.push_back(i);
-		}
+// Scan one member (tar entry or framed record) of the given size,
+// straight from the stream
+//   Returns false if the input ends early.
+bool StyleScanner::scanStreamMember(istream &in, const string &name,
+	long size)
+{
+	reset();
+	startFile(name, true);
+	if (!readStreamBytes(in, size)) {
+		metrics.recordFailure();
+		return false;
 	}
-	printErrors("Tabs should be used for indents", errorLines);
+	loadFileText();
+	checkLoadedFile();
+	return true;
 }
 
-// Is this line in the middle of a C-style block comment?
-bool StyleScanner::isMidBlockComment(int line){
-	return commentLines[line] == C_COMMENT
-		&& (line > 0 && commentLines[line - 1] == C_COMMENT)
-		&& (line < getSize(commentLines) - 1 
-			&& commentLines[line + 1] == C_COMMENT);
+// Is this a zip archive name?
+bool StyleScanner::isZipName(const string &name) {
+	return endsWith(name, ".zip");
 }
 
-// Is this line possibly a run-on (continuation) statement?
-bool StyleScanner::mayBeRunOnLine(int line) {
-	if (line > 0 && scopeLevels[line] == scopeLevels[line - 1]
-		&& !commentLines[line - 1] && !isBlank(line - 1))
-	{
-		string priorLine = fileLines[line - 1];
-		int lastPriorChar = getLastNonspacePos(priorLine);
-		if (priorLine[lastPriorChar] != SEMICOLON) {
-			return true;
-		}
-	}
-	return false;
+// Does this text start with a zip local file header?
+bool StyleScanner::isZipData(const string &text) {
+	return text.compare(0, 4, "PK\3\4") == 0;
 }
 
-// Is this line at an acceptable indent level?
-bool StyleScanner::isOkayIndentLevel(int line) {
-
-	// Ignore some cases
-	if (isBlank(line) || isMidBlockComment(line) || !isIndentTabs(line)) {
-		return true;
+// Scan a zip archive file, read whole into memory
+//   The central directory at the end must be found before any member.
+void StyleScanner::scanZipFile(const string &name) {
+	ifstream inFile(name, ios::binary);
+	if (!inFile) {
+		cerr << "Error: File not found.\n";
+		metrics.recordFailure();
+		return;
 	}
+	archiveText.assign(istreambuf_iterator<char>(inFile),
+		istreambuf_iterator<char>());
+	scanZipArchive(name);
+	archiveText.clear();
+}
 
-	// Get scope & tab levels
-	int scopeLevel = scopeLevels[line];
-	int numStartTabs = getStartTabCount(fileLines[line]);
+// Scan a zip archive read whole from standard input
+void StyleScanner::scanZipText() {
+	archiveText.swap(fileText);
+	string archiveName = fileName;
+	scanZipArchive(archiveName);
+	archiveText.clear();
+}
 
-	// Comments before a case permit one less indent (sketchy at first)
-	if (isCommentBeforeCase(line)) {
-		return numStartTabs	== scopeLevel
-			|| numStartTabs == scopeLevel - 1;
+// Scan each source file member listed in a zip central directory
+//   Members are scanned in directory order; directories & other
+//   files are skipped. Zip64 archives are not supported.
+void StyleScanner::scanZipArchive(const string &archiveName) {
+	size_t end = findZipDirectoryEnd();
+	if (end == string::npos) {
+		cerr << "Error: Not a zip archive (no central directory).\n";
+		metrics.recordFailure();
+		return;
 	}
+	int numEntries = getLittleEndian(archiveText, end + 10, 2);
+	size_t entry = getLittleEndian(archiveText, end + 16, 4);
+	for (int i = 0; i < numEntries; i++) {
+		if (entry + ZIP_ENTRY_SIZE > archiveText.size()
+			|| archiveText.compare(entry, 4, "PK\1\2") != 0)
+		{
+			cerr << "Error: Archive is truncated.\n";
+			return;
+		}
 
-	// Run-on (continuation) lines handling:
-	//   Artistic Style uses spaces, so require at least scope tabs
-	if (mayBeRunOnLine(line)) {
-		return numStartTabs >= scopeLevel;
+		// Scan a source file member, then step to the next entry
+		int nameLength = getLittleEndian(archiveText, entry + 28, 2);
+		string name = archiveText.substr(entry + ZIP_ENTRY_SIZE, nameLength);
+		if (isSourceName(name)) {
+			scanZipMember(archiveName + ":" + name, entry);
+		}
+		entry = getZipEntryEnd(entry);
 	}
+}
 
-	// Standard indent case
-	return numStartTabs == scopeLevel;
+// Get the end of a zip central directory entry (name, extra, comment)
+size_t StyleScanner::getZipEntryEnd(size_t entry) {
+	return entry + ZIP_ENTRY_SIZE
+		+ getLittleEndian(archiveText, entry + 28, 2)
+		+ getLittleEndian(archiveText, entry + 30, 2)
+		+ getLittleEndian(archiveText, entry + 32, 2);
 }
 
-// Check indent levels
-void StyleScanner::checkIndentLevels() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isOkayIndentLevel(i)) {
-			errorLines.push_back(i);
+// Find the zip end of central directory record
+//   It ends the archive, but may be followed by a comment.
+size_t StyleScanner::findZipDirectoryEnd() {
+	const size_t MAX_COMMENT = 65535;
+	if (archiveText.size() < ZIP_END_SIZE) {
+		return string::npos;
+	}
+	size_t last = archiveText.size() - ZIP_END_SIZE;
+	size_t first = last > MAX_COMMENT ? last - MAX_COMMENT : 0;
+	for (size_t pos = last + 1; pos-- > first; ) {
+		if (archiveText.compare(pos, 4, "PK\5\6") == 0) {
+			return pos;
 		}
 	}
-	printErrors("Indent level errors", errorLines);
+	return string::npos;
 }
 
-// Check blanks before comments (required)
-void StyleScanner::checkBlanksBeforeComments() {
-	vector<int> errorLines;
-	for (int i = 1; i < getSize(fileLines); i++) {
-		if (commentLines[i]
-			&& !commentLines[i - 1]
-			&& !isBlankOrBrace(i - 1))
-		{
-			errorLines.push_back(i);
-		}
+// Scan one zip member, decoded straight into the file text
+void StyleScanner::scanZipMember(const string &name, size_t entry) {
+	reset();
+	startFile(name, true);
+	if (!decodeZipMember(entry)) {
+		cerr << "Error: Cannot decode member.\n";
+		metrics.recordFailure();
+		return;
 	}
-	printErrors("Missing blank line before comment", errorLines);
+	loadFileText();
+	checkLoadedFile();
 }
 
-// Check for no comments in long stretch of statements
-void StyleScanner::checkTooFewComments() {
-	const int LONG_STRETCH = 25;
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (commentLines[i]) {
-			int end = i + 1;
-			while (end < getSize(fileLines) && !commentLines[end++]);
-			int span = end - i - 2;
-			if (span > LONG_STRETCH) {
-				errorLines.push_back(i + LONG_STRETCH / 2);
-			}
-			i = end;
-		}
+// Decode a zip member's data, given its central directory entry
+//   Sizes come from the directory, as the local header may lack them.
+//   Handles stored & deflated members; not encrypted ones.
+bool StyleScanner::decodeZipMember(size_t entry) {
+	int method = getLittleEndian(archiveText, entry + 10, 2);
+	size_t packedSize = getLittleEndian(archiveText, entry + 20, 4);
+	size_t size = getLittleEndian(archiveText, entry + 24, 4);
+	size_t data = getZipDataStart(entry);
+	if (data == string::npos || data + packedSize > archiveText.size()) {
+		return false;
+	}
+	if (method == 0) {
+		fileText.assign(archiveText, data, packedSize);
 	}
-	printErrors("Too few comments", errorLines);
+	else if (method != 8 || !inflater.inflate(archiveText.data() + data,
+		packedSize, fileText, size))
+	{
+		return false;
+	}
+	return fileText.size() == size
+		&& getCrc32(fileText) == getLittleEndian(archiveText, entry + 16, 4);
 }
 
-// Check that next N lines all in same scope
-bool StyleScanner::isSameScope(int startLine, int numLines) {
-	if (startLine >= 0
-		&& startLine + numLines < getSize(fileLines))
+// Find a zip member's data, past its local header
+//   Returns npos for a bad header or an encrypted member.
+size_t StyleScanner::getZipDataStart(size_t entry) {
+	int flags = getLittleEndian(archiveText, entry + 8, 2);
+	size_t local = getLittleEndian(archiveText, entry + 42, 4);
+	if ((flags & 1) || local + ZIP_LOCAL_SIZE > archiveText.size()
+		|| archiveText.compare(local, 4, "PK\3\4") != 0)
 	{
-		int startLevel = scopeLevels[startLine];
-		for (int i = 1; i <= numLines; i++) {
-			if (scopeLevels[startLine + i] != startLevel) {
-				return false;
-			}
+		return string::npos;
+	}
+	return local + ZIP_LOCAL_SIZE
+		+ getLittleEndian(archiveText, local + 26, 2)
+		+ getLittleEndian(archiveText, local + 28, 2);
+}
+
+// Is this a source file name (not, e.g., an editor swap file)?
+bool StyleScanner::isSourceName(const string &name) {
+	const string EXTENSIONS[] = {".cpp", ".cc", ".cxx", ".c",
+		".h", ".hpp"};
+	size_t slash = name.rfind('/');
+	size_t start = slash == string::npos ? 0 : slash + 1;
+	if (start >= name.size() || name[start] == '.') {
+		return false;
+	}
+	for (const string &extension: EXTENSIONS) {
+		if (endsWith(name, extension)) {
+			return true;
 		}
-		return true;
 	}
 	return false;
 }
 
-// Check for commenting multiple single-line statements
-void StyleScanner::checkTooManyComments() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines) - 5; i++) {
-		if (commentLines[i]
-			&& !commentLines[i + 1]
-			&& isBlank(i + 2)
-			&& commentLines[i + 3]
-			&& !commentLines[i + 4]
-			&& isBlank(i + 5)
-			&& isSameScope(i, 5))
-		{
-			errorLines.push_back(i + 3);
-		}
+// Does a string end with this suffix?
+bool endsWith(const string &s, const string &suffix) {
+	return s.size() >= suffix.size()
+		&& s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Get a name to write a file under before renaming it into place
+//   Includes the process ID, so concurrent runs don't collide.
+string getTempName(const string &name) {
+	long id = 0;
+	#ifdef __unix__
+	id = getpid();
+	#endif
+	#ifdef _WIN32
+	id = _getpid();
+	#endif
+	return name + "." + to_string(id) + ".tmp";
+}
+
+// Quote a string for a POSIX shell command line
+string shellQuote(const string &s) {
+	string quoted = "'";
+	for (char c: s) {
+		quoted += c == '\'' ? string("'\\''") : string(1, c);
 	}
-	printErrors("Too many comments", errorLines);
+	return quoted + "'";
 }
 
-// Is this character an operator that expects spacing?
-//    Note we must skip many symbols used for other purposes, e.g.:
-//   '<', '>' used for brackets in #includes, templates
-//   "++", "--" pre/postfix to variable
-//   "+" used in name of overloaded operator+
-//   "-" used for unary negation (start number)
-//   "*" used for pointer operator
-//   "/" used in units (e.g., ft/sec)
-bool StyleScanner::isSpacedOperator(const string &s) {
-	const string SPACE_OPS[] = {"%", "<<", ">>", "<=", ">=",
-		"==", "!=", "&&", "||", "=", "+=", "-=", "*=", "/="};
-	for (string op: SPACE_OPS) {
-		if (s == op) {
-			return true;
-		}
+// Get an unsigned little-endian number from bytes in a string
+size_t getLittleEndian(const string &data, size_t pos, int numBytes) {
+	size_t value = 0;
+	for (int i = numBytes - 1; i >= 0; i--) {
+		value = value << 8 | (unsigned char) data[pos + i];
 	}
-	return false;
+	return value;
 }
 
-// Check spaces around operators
-void StyleScanner::checkSpacedOperators() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			int pos = 0;
-			string line = fileLines[i];
-			string token = getNextToken(line, pos);
-			while (token != "") {
-				if (isSpacedOperator(token)) {
-
-					// Check for space before & after
-					int startPos = pos - token.length();
-					if ((startPos > 0 && !isspace(line[startPos - 1]))
-						|| (pos < getLength(line) && !isspace(line[pos])))
-					{
-						errorLines.push_back(i);
-						break;
-					}
-				}
-				token = getNextToken(line, pos);
+// Get the CRC-32 of a string (as in zip & gzip files)
+uint32_t getCrc32(const string &data) {
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; bit++) {
+				value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
 			}
+			table[i] = value;
 		}
 	}
-	printErrors("Operators should have surrounding spaces", errorLines);
+	uint32_t crc = 0xFFFFFFFF;
+	for (unsigned char c: data) {
+		crc = table[(crc ^ c) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
 }
 
-// Check for endline C-style comments that continue to next line
-//   Never seen this, but it would foil all our other comment logic.
-void StyleScanner::checkEndlineRunonComments() {
-	vector<int> errorLines;
-	for (int i = 1; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)
-			&& fileLines[i].find(C_COMMENT_START) != string::npos
-			&& fileLines[i].find(C_COMMENT_END) == string::npos)
-		{
-			errorLines.push_back(i);
-		}
+// Get a UTF-16 code unit from two bytes in a string
+uint32_t getUtf16Unit(const string &data, size_t pos, bool isBigEndian) {
+	unsigned char first = data[pos];
+	unsigned char second = data[pos + 1];
+	return isBigEndian ? first << 8 | second : second << 8 | first;
+}
+
+// Append a Unicode code point as UTF-8
+void appendUtf8(string &out, uint32_t code) {
+	if (code < 0x80) {
+		out += (char) code;
+	}
+	else if (code < 0x800) {
+		out += (char) (0xC0 | (code >> 6));
+	}
+	else if (code < 0x10000) {
+		out += (char) (0xE0 | (code >> 12));
+	}
+	else {
+		out += (char) (0xF0 | (code >> 18));
+		out += (char) (0x80 | ((code >> 12) & 0x3F));
+	}
+	if (code >= 0x800) {
+		out += (char) (0x80 | ((code >> 6) & 0x3F));
+	}
+	if (code >= 0x80) {
+		out += (char) (0x80 | (code & 0x3F));
 	}
-	printErrors("Endline run-on comments are very bad", errorLines);
 }
 
-// Is this a punctuation character?
-//   Can't do colons, b/c of time, scope-resolution operator.
-//   Can't do question mark, b/c conventionally has space before.
-//   Commas in big numbers problematic (but retain check for now).
-bool StyleScanner::isPunctuation(char c) {
-	const char PUNCT[] = {COMMA, SEMICOLON};
-	for (char punct: PUNCT) {
-		if (c == punct) {
-			return true;
-		}
+// Make a stream buffer over bytes in memory
+MemoryBuf::MemoryBuf(char *data, size_t size) {
+	setg(data, data, data + size);
+}
+
+// Make a stream buffer over a C stdio stream
+PipeBuf::PipeBuf(FILE *input) {
+	inFile = input;
+}
+
+// Refill the buffer from the stdio stream
+int PipeBuf::underflow() {
+	size_t count = inFile ? fread(buffer, 1, sizeof buffer, inFile) : 0;
+	if (count == 0) {
+		return traits_type::eof();
 	}
-	return false;
+	setg(buffer, buffer, buffer + count);
+	return traits_type::to_int_type(buffer[0]);
 }
 
-// Is this an acceptable post-punctuation character?
-//   Quotes or escapes may follow in a string literal.
-bool StyleScanner::isPunctuationChaser(char c) {
-	const char CHASERS[] = {' ', '\n', '\t', '\"', '\\'};
-	for (char chaser: CHASERS) {
-		if (c == chaser) {
-			return true;
-		}
+// Make a buffer for output to a C stdio stream
+OutputBuf::OutputBuf(FILE *output) {
+	outFile = output;
+	setp(buffer, buffer + sizeof buffer);
+}
+
+// Write the full buffer, then keep the character that did not fit
+int OutputBuf::overflow(int c) {
+	if (writeBuffer() != 0) {
+		return traits_type::eof();
 	}
-	return false;
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
 }
 
-// Check for spaces after punctuation, but not before
-void StyleScanner::checkPunctuationSpacing() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		string line = fileLines[i];
-		for (int j = 0; j < getLength(line); j++) {
-			if (isPunctuation(line[j])) {
-				if (((j > 1 && isspace(line[j - 1]))
-					|| (j < getLength(line) - 1
-					&& !isPunctuationChaser(line[j + 1]))))
-				{
-					errorLines.push_back(i);
-					break;
-				}
-			}
+// Flush: write the buffer & the stdio stream's own
+int OutputBuf::sync() {
+	return writeBuffer() == 0 && fflush(outFile) == 0 ? 0 : -1;
+}
+
+// Write & empty the buffer
+int OutputBuf::writeBuffer() {
+	size_t count = pptr() - pbase();
+	size_t written = fwrite(pbase(), 1, count, outFile);
+	setp(buffer, buffer + sizeof buffer);
+	return written == count ? 0 : -1;
+}
+
+// Make an inflater, with the fixed Huffman tables built once
+Inflater::Inflater() {
+	short lengths[FIXED_LENGTH_CODES];
+	for (int i = 0; i < FIXED_LENGTH_CODES; i++) {
+		lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+	}
+	buildTable(fixedLengths, lengths, FIXED_LENGTH_CODES);
+	fill_n(lengths, MAX_DISTANCE_CODES, 5);
+	buildTable(fixedDistances, lengths, MAX_DISTANCE_CODES);
+}
+
+// Inflate raw DEFLATE data into out
+//   Output past maxSize is treated as corrupt (e.g., a zip bomb); the
+//   claimed size only limits output, as it may be forged, so space is
+//   reserved from the input size. Returns false on bad or truncated
+//   data, or if the output will not fit in memory.
+bool Inflater::inflate(const char *data, size_t size, string &out,
+	size_t maxSize)
+{
+	input = (const unsigned char*) data;
+	inputSize = size;
+	inputPos = 0;
+	bitBuffer = 0;
+	bitCount = 0;
+	isOverrun = false;
+	output = &out;
+	outputLimit = maxSize;
+	out.clear();
+	try {
+		out.reserve(min(maxSize, size * RESERVE_RATIO));
+		return decodeBlocks();
+	}
+	catch (const bad_alloc &) {
+		out.clear();
+		out.shrink_to_fit();
+		return false;
+	}
+}
+
+// Decode DEFLATE blocks through the last one
+bool Inflater::decodeBlocks() {
+	bool isLast = false;
+	bool isOk = true;
+	while (!isLast && isOk) {
+		isLast = getBits(1);
+		int type = getBits(2);
+		isOk = type == 0 ? copyStored()
+			: type == 1 ? decodeCodes(fixedLengths, fixedDistances)
+			: type == 2 && decodeDynamic();
+	}
+	return isOk && !isOverrun;
+}
+
+// Get the next count bits of input, least significant first
+//   Past the end of input, gives zeros & sets the overrun flag.
+int Inflater::getBits(int count) {
+	long value = bitBuffer;
+	while (bitCount < count) {
+		if (inputPos == inputSize) {
+			isOverrun = true;
+			return 0;
 		}
+		value |= (long) input[inputPos++] << bitCount;
+		bitCount += 8;
 	}
-	printErrors("Punctuation should have space afterward", errorLines);
+	bitBuffer = value >> count;
+	bitCount -= count;
+	return (int) (value & ((1L << count) - 1));
 }
 
-// Get next token from a line
-//   Splits on spaces, identifiers, numbers, and punctuation.
-//   Simplistic: Gets blocks of punctuation, glues grouping symbols, etc.
-//   Starts at pos; updates pos to after found token.
-string StyleScanner::getNextToken(const string &s, int &pos) {
+// Copy a stored (uncompressed) block
+bool Inflater::copyStored() {
+	bitBuffer = 0;
+	bitCount = 0;
+	if (inputPos + 4 > inputSize) {
+		return false;
+	}
+	size_t length = input[inputPos] | input[inputPos + 1] << 8;
+	size_t check = input[inputPos + 2] | input[inputPos + 3] << 8;
+	inputPos += 4;
+	if (length != (~check & 0xFFFF) || inputPos + length > inputSize
+		|| output->size() + length > outputLimit)
+	{
+		return false;
+	}
+	output->append((const char*) input + inputPos, length);
+	inputPos += length;
+	return true;
+}
 
-	// Eat spaces
-	while (pos < getLength(s) && isspace(s[pos])) {
-		pos++;
+// Decode a block with dynamic Huffman codes
+//   Code lengths are themselves Huffman coded, in a fixed order.
+bool Inflater::decodeDynamic() {
+	static const short ORDER[] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11,
+		4, 12, 3, 13, 2, 14, 1, 15};
+	int numLengths = getBits(5) + 257;
+	int numDistances = getBits(5) + 1;
+	int numCodes = getBits(4) + 4;
+	if (numLengths > MAX_LENGTH_CODES || numDistances > MAX_DISTANCE_CODES) {
+		return false;
 	}
+	short lengths[MAX_LENGTH_CODES + MAX_DISTANCE_CODES] = {};
+	for (int i = 0; i < numCodes; i++) {
+		lengths[ORDER[i]] = getBits(3);
+	}
+	HuffmanTable codeTable;
+	HuffmanTable lengthTable;
+	HuffmanTable distanceTable;
+	return buildTable(codeTable, lengths, 19) == 0
+		&& readCodeLengths(lengths, numLengths + numDistances, codeTable)
+		&& lengths[256] != 0
+		&& buildTable(lengthTable, lengths, numLengths) >= 0
+		&& buildTable(distanceTable, lengths + numLengths, numDistances) >= 0
+		&& decodeCodes(lengthTable, distanceTable);
+}
 
-	// Get nothing
-	if (pos >= getLength(s)) {
-		return "";
+// Read count literal/length & distance code lengths
+//   Symbols 16-18 repeat the last length, or zeros, for a run.
+bool Inflater::readCodeLengths(short *lengths, int count,
+	const HuffmanTable &codeTable)
+{
+	int index = 0;
+	while (index < count && !isOverrun) {
+		int symbol = decodeSymbol(codeTable);
+		if (symbol < 0 || (symbol == 16 && index == 0)) {
+			return false;
+		}
+		if (symbol < 16) {
+			lengths[index++] = symbol;
+			continue;
+		}
+		short repeated = symbol == 16 ? lengths[index - 1] : 0;
+		int runLength = symbol == 16 ? 3 + getBits(2)
+			: symbol == 17 ? 3 + getBits(3) : 11 + getBits(7);
+		if (index + runLength > count) {
+			return false;
+		}
+		fill_n(lengths + index, runLength, repeated);
+		index += runLength;
 	}
+	return !isOverrun;
+}
 
-	// Find token end
-	else {
-		int start = pos;
-		pos = findTokenEnd(s, pos);
-		return s.substr(start, pos - start);
+// Decode literals & back-references until end of block
+bool Inflater::decodeCodes(const HuffmanTable &lengthTable,
+	const HuffmanTable &distanceTable)
+{
+	int symbol = decodeSymbol(lengthTable);
+	while (symbol != 256 && !isOverrun) {
+		if (symbol < 256) {
+			*output += (char) symbol;
+		}
+		else {
+
+			// Copy a back-reference: length, then distance back
+			symbol -= 257;
+			if (symbol < 0 || symbol >= 29) return false;
+			size_t length = LENGTH_BASE[symbol] + getBits(LENGTH_EXTRA[symbol]);
+			symbol = decodeSymbol(distanceTable);
+			if (symbol < 0 || symbol >= 30) return false;
+			size_t distance = DISTANCE_BASE[symbol]
+				+ getBits(DISTANCE_EXTRA[symbol]);
+			if (distance > output->size()) return false;
+			for (size_t i = 0; i < length; i++) {
+				*output += (*output)[output->size() - distance];
+			}
+		}
+		if (output->size() > outputLimit) return false;
+		symbol = decodeSymbol(lengthTable);
 	}
+	return !isOverrun;
 }
 
-// Find token end from legitimate start position
-//   Can identify a word, number, or punctuation series
-int StyleScanner::findTokenEnd(const string &s, int pos) {
-	assert(pos < getLength(s));
-	assert(!isspace(s[pos]));
-	if (isalpha(s[pos]) || s[pos] == '_') {
-		while (pos < getLength(s) && (isalnum(s[pos]) || s[pos] == '_')) {
-			pos++;
+// Build a decoding table from code lengths
+//   Returns 0 if complete, > 0 if incomplete, < 0 if over-subscribed.
+int Inflater::buildTable(HuffmanTable &table, const short *lengths,
+	int count)
+{
+	fill_n(table.counts, MAX_CODE_BITS + 1, 0);
+	for (int i = 0; i < count; i++) {
+		table.counts[lengths[i]]++;
+	}
+	if (table.counts[0] == count) {
+		return 0;
+	}
+	int left = 1;
+	short offsets[MAX_CODE_BITS + 1] = {};
+	for (int bits = 1; bits <= MAX_CODE_BITS; bits++) {
+		left = (left << 1) - table.counts[bits];
+		if (left < 0) {
+			return left;
+		}
+		if (bits < MAX_CODE_BITS) {
+			offsets[bits + 1] = offsets[bits] + table.counts[bits];
 		}
 	}
-	else if (isdigit(s[pos])) {
-		while (pos < getLength(s) && (isdigit(s[pos]) || s[pos] == '.')) {
-			pos++;
+	for (int i = 0; i < count; i++) {
+		if (lengths[i] != 0) {
+			table.symbols[offsets[lengths[i]]++] = i;
 		}
 	}
-	else if (ispunct(s[pos])) {
-		while (pos < getLength(s) && ispunct(s[pos])) {
-			pos++;
+	return left;
+}
+
+// Decode one symbol, reading its code bit by bit
+//   Returns -1 for an invalid code.
+int Inflater::decodeSymbol(const HuffmanTable &table) {
+	int code = 0;
+	int first = 0;
+	int index = 0;
+	for (int bits = 1; bits <= MAX_CODE_BITS; bits++) {
+		code |= getBits(1);
+		int count = table.counts[bits];
+		if (code - count < first) {
+			return table.symbols[index + (code - first)];
 		}
+		index += count;
+		first = (first + count) << 1;
+		code <<= 1;
 	}
-	return pos;
+	return -1;
 }
 
-// Get first token on a line
-string StyleScanner::getFirstToken(const string &s) {
-	int pos = 0;
-	return getNextToken(s, pos);
+// Read the whole file into one buffer
+//   Sized from the file when it can be; else read in blocks.
+//   The stream uses our own buffer, so opening it doesn't allocate.
+bool StyleScanner::readFileText() {
+	ifstream inFile;
+	inFile.rdbuf()->pubsetbuf(readBuffer, sizeof readBuffer);
+	inFile.open(fileName);
+	if (!inFile || isDirectory(fileName)) {
+		return false;
+	}
+
+	// Read a stream with no known size (pipe, FIFO, /proc) in blocks
+	inFile.seekg(0, ios::end);
+	streamoff size = inFile.tellg();
+	if (size <= 0) {
+		inFile.clear();
+		inFile.seekg(0, ios::beg);
+		inFile.clear();
+		return readStreamText(inFile);
+	}
+	fileText.resize((size_t) size);
+	inFile.seekg(0, ios::beg);
+	inFile.read(&fileText[0], fileText.size());
+	fileText.resize((size_t) inFile.gcount());
+	return true;
 }
 
-// Get last token on a line
-string StyleScanner::getLastToken(const string &s) {
-	int pos = 0;
-	string lastToken = "";
-	string nextToken = getNextToken(s, pos);
-	while (nextToken != "") {
-		lastToken = nextToken;
-		nextToken = getNextToken(s, pos);
+// Read a counted run of bytes from a stream into the file buffer
+//   Grows the buffer as data arrives, rather than trusting the count
+//   (e.g., from an archive header) for one allocation up front.
+//   Returns false if the stream ends first.
+bool StyleScanner::readStreamBytes(istream &in, long size) {
+	const long BLOCK_SIZE = 65536;
+	fileText.clear();
+	while (size > 0 && in) {
+		size_t oldSize = fileText.size();
+		fileText.resize(oldSize + min(size, BLOCK_SIZE));
+		in.read(&fileText[oldSize], fileText.size() - oldSize);
+		fileText.resize(oldSize + (size_t) in.gcount());
+		size -= in.gcount();
+	}
+	return size <= 0;
+}
+
+// Read a whole stream of unknown size into the file buffer
+//   Reads in blocks, for pipes that cannot seek.
+bool StyleScanner::readStreamText(istream &in) {
+	fileText.clear();
+	return appendStreamText(in);
+}
+
+// Read the rest of a stream onto the end of the file buffer
+bool StyleScanner::appendStreamText(istream &in) {
+	const int BLOCK_SIZE = 65536;
+	while (in) {
+		size_t oldSize = fileText.size();
+		fileText.resize(oldSize + BLOCK_SIZE);
+		in.read(&fileText[oldSize], BLOCK_SIZE);
+		fileText.resize(oldSize + (size_t) in.gcount());
+	}
+	return !in.bad();
+}
+
+// Split the file buffer into lines
+//   Line storage is sized up front, rather than grown per line,
+//   and line strings are reused from earlier files where possible.
+//   Matches getline() results: a final newline gives a last empty line.
+void StyleScanner::splitFileLines() {
+	normalizeFileText();
+	int numLines = count(fileText.begin(), fileText.end(), '\n') + 1;
+	resizeFileLines(numLines);
+	size_t start = 0;
+	for (int i = 0; i < numLines; i++) {
+		size_t end = min(fileText.find('\n', start), fileText.size());
+		fileLines[i].assign(fileText, start, end - start);
+		start = end + 1;
+	}
+}
+
+// Normalize file text to UTF-8 with LF line ends
+//   Strips a byte order mark (which would hide the header comment),
+//   converts UTF-16, & turns CRLF or lone CR ends into LF, so no line
+//   keeps a carriage return (e.g., counted toward line length).
+void StyleScanner::normalizeFileText() {
+	if (fileText.compare(0, 3, BYTE_ORDER_MARK) == 0) {
+		fileText.erase(0, 3);
+	}
+	else if (isUtf16Text()) {
+		convertUtf16Text();
+	}
+	if (memchr(fileText.data(), '\r', fileText.size()) != nullptr) {
+		normalizeLineEnds();
+	}
+}
+
+// Does the file text look like UTF-16?
+//   It starts with a UTF-16 byte order mark, or else each of its
+//   first characters has a zero byte on the same side (as ASCII text
+//   would), so a stray zero byte in other files doesn't qualify.
+bool StyleScanner::isUtf16Text() {
+	const size_t SAMPLE_BYTES = 128;
+	if (fileText.compare(0, 2, "\xFF\xFE") == 0
+		|| fileText.compare(0, 2, "\xFE\xFF") == 0)
+	{
+		return true;
+	}
+	size_t end = min(fileText.size(), SAMPLE_BYTES) / 2 * 2;
+	int zeroSide = fileText[0] == '\0' ? 0 : 1;
+	for (size_t i = 0; i < end; i += 2) {
+		if (fileText[i + zeroSide] != '\0'
+			|| fileText[i + 1 - zeroSide] == '\0')
+		{
+			return false;
+		}
+	}
+	return end > 0;
+}
+
+// Convert UTF-16 file text to UTF-8
+//   Byte order is from the byte order mark, if any, or else from
+//   which byte of the first (ASCII) character is zero.
+void StyleScanner::convertUtf16Text() {
+	bool isBigEndian = fileText[0] == '\0' || fileText[0] == '\xFE';
+	size_t start = fileText[0] == '\0' || fileText[1] == '\0' ? 0 : 2;
+	string text;
+	text.reserve(fileText.size());
+	for (size_t i = start; i + 1 < fileText.size(); i += 2) {
+		uint32_t code = getUtf16Unit(fileText, i, isBigEndian);
+		uint32_t next = i + 3 < fileText.size()
+			? getUtf16Unit(fileText, i + 2, isBigEndian) : 0;
+		if (code >= 0xD800 && code < 0xDC00 && next >= 0xDC00
+			&& next < 0xE000)
+		{
+			code = 0x10000 + ((code - 0xD800) << 10) + (next - 0xDC00);
+			i += 2;
+		}
+		appendUtf8(text, code);
+	}
+	fileText.swap(text);
+}
+
+// Turn CRLF & lone CR line ends into LF, in place
+//   Copies the runs between carriage returns found with memchr.
+void StyleScanner::normalizeLineEnds() {
+	char *text = &fileText[0];
+	char *end = text + fileText.size();
+	char *out = text;
+	char *from = text;
+	char *cr = (char*) memchr(from, '\r', end - from);
+	while (cr != nullptr) {
+		memmove(out, from, cr - from);
+		out += cr - from;
+		*out++ = '\n';
+		from = cr + 1 < end && cr[1] == '\n' ? cr + 2 : cr + 1;
+		cr = (char*) memchr(from, '\r', end - from);
+	}
+	memmove(out, from, end - from);
+	out += end - from;
+	fileText.resize(out - text);
+}
+
+// Resize the file lines vector
+//   Dropped line strings are kept as spares, with their capacity,
+//   and are reused before any new strings are made.
+void StyleScanner::resizeFileLines(int numLines) {
+	while (getSize(fileLines) > numLines) {
+		spareLines.push_back(move(fileLines.back()));
+		fileLines.pop_back();
+	}
+	while (getSize(fileLines) < numLines) {
+		if (spareLines.empty()) {
+			fileLines.emplace_back();
+		}
+		else {
+			fileLines.push_back(move(spareLines.back()));
+			spareLines.pop_back();
+		}
+	}
+
+	// Make room for every line string to be a spare, while growing
+	spareLines.reserve(fileLines.capacity());
+}
+
+// Post-processing scans on read file
+void StyleScanner::prescanFile() {
+	scanCommentLines();
+	scanNewTypeDefs();
+	scanScopeLevels();
+	scanScopeLabels();
+	markStage(STAGE_PRESCAN);
+}
+
+// Print the read file (for testing)
+void StyleScanner::writeFile() {
+	for (const string &line: fileLines) {
+		cout << line << "\n";
+	}
+	cout << "\n";
+}
+
+// Get integer-length of a string
+//   (Silences compiler warnings on conversion.)
+int StyleScanner::getLength(const string &line) {
+	return (int) line.length();	
+}
+
+// Get integer-size of a vector of strings
+//   (Silences compiler warnings on conversion.)
+int StyleScanner::getSize(const vector<string> &vec) {
+	return (int) vec.size();	
+}
+
+// Get integer-size of a vector of ints
+//   (Silences compiler warnings on conversion.)
+int StyleScanner::getSize(const vector<int> &vec) {
+	return (int) vec.size();	
+}
+
+// Get first nonspace position in a string
+//   Returns -1 if none such.
+int StyleScanner::getFirstNonspacePos(const string &line) {
+	for (int i = 0; i < getLength(line); i++) {
+		if (!isspace(line[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Get last nonspace position in a string
+//   Returns -1 if none such.
+int StyleScanner::getLastNonspacePos(const string &line) {
+	for (int i = getLength(line) - 1; i >= 0; i--) {
+		if (!isspace(line[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Is this line a blank (all whitespace)?
+bool StyleScanner::isBlank(const string &line) {
+	return getFirstNonspacePos(line) == -1;
+}
+
+// Is this line number a blank?
+bool StyleScanner::isBlank(int line) {
+	return isBlank(fileLines[line]);
+}
+
+// Is this line solely a left-brace?
+bool StyleScanner::isLeftBrace(int line) {
+	int startPos = getFirstNonspacePos(fileLines[line]);
+	int endPos = getLastNonspacePos(fileLines[line]);
+	return startPos != -1
+		&& startPos == endPos
+		&& fileLines[line][startPos] == LEFT_BRACE;
+}
+
+// Is this line either blank or a left-brace?
+bool StyleScanner::isBlankOrBrace(int line) {
+	return isBlank(line) || isLeftBrace(line);	
+}
+
+// Does string s start with string t?
+bool StyleScanner::stringStartsWith(const string &s, const string &t) {
+	return s.rfind(t, 0) == 0;
+}
+
+// Does string s end with string t?
+bool StyleScanner::stringEndsWith(const string &s, const string &t) {
+	return s.find(t, s.length() - t.length()) != string::npos;
+}
+
+// Find where the comment lines are
+//    Assumes comments are full lines (no endline comments, etc.)
+void StyleScanner::scanCommentLines() {
+	commentLines.resize(getSize(fileLines));
+	bool inCstyleComment = false;
+	for (int i = 0; i < getSize(fileLines); i++) {
+		inCstyleComment = scanCommentLine(i, inCstyleComment);
+	}
+}
+
+// Find whether one line is a comment
+//   Takes & returns whether we are in a C-style comment.
+bool StyleScanner::scanCommentLine(int i, bool inCstyleComment) {
+	const auto &line = fileLines[i];
+	commentLines[i] = NO_COMMENT;
+
+	// Check C-style comment
+	if (firstTokenStartsWith(line, C_COMMENT_START)) {
+		inCstyleComment = true;
+	}
+	if (inCstyleComment) {
+		commentLines[i] = C_COMMENT;
+	}
+	if (lastTokenEndsWith(line, C_COMMENT_END)) {
+		inCstyleComment = false;
+	}
+
+	// Check C++-style comment
+	if (firstTokenStartsWith(line, DOUBLE_SLASH)) {
+		commentLines[i] = CPP_COMMENT;
+	}
+	return inCstyleComment;
+}
+
+// Is the line a (full-line) comment?
+bool StyleScanner::isCommentLine(int line) {
+	assert(0 <= line && line < getSize(fileLines));
+	return (bool) commentLines[line];
+}
+
+// Is the line a comment before a case or default label?
+bool StyleScanner::isCommentBeforeCase(int line) {
+	assert(0 <= line && line < getSize(fileLines));
+	if (isCommentLine(line)) {
+		for (int cLine = line + 1; cLine < getSize(fileLines); cLine++) {
+			if (isCommentLine(cLine)) continue;
+			const auto &nextLine = fileLines[cLine];
+			return isFirstToken(nextLine, "case")
+				|| isFirstToken(nextLine, "default");
+		}
+	}
+	return false;
+}
+
+// Does this line start with an opening brace?
+bool StyleScanner::isLineStartOpenBrace(const string &line) {
+	int firstPos = getFirstNonspacePos(line);
+	return firstPos >= 0 && line[firstPos] == LEFT_BRACE;
+}
+
+// Does this line start with a closing brace?
+bool StyleScanner::isLineStartCloseBrace(const string &line) {
+	int firstPos = getFirstNonspacePos(line);
+	return firstPos >= 0 && line[firstPos] == RIGHT_BRACE;
+}
+
+// Does this line start with a label of interest?
+bool StyleScanner::isLineLabel(const string &line) {
+	static const string LABELS[] = {"case", "default",
+		"public", "private", "protected"};
+	for (const string &label: LABELS) {
+		if (isFirstToken(line, label)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Does this line end with a semicolon?
+bool StyleScanner::isLineEndingSemicolon(const string &line) {
+	int lastPos = getLastNonspacePos(line);
+	return lastPos != -1 && line[lastPos] == SEMICOLON;
+}
+
+// Scan for new type names
+//   Note currently just class/structs
+//   (not actual "typedef" statements)
+void StyleScanner::scanNewTypeDefs() {
+	for (int i = 0; i < getSize(fileLines); i++) {
+		scanNewTypeDef(i);
+	}
+	keyNewTypes();
+}
+
+// Key the types seen, for memoized verdicts that depend on them
+void StyleScanner::keyNewTypes() {
+	typesKey = 0;
+	if (projectMode) {
+		typesKey = projectTypesKey;
+		for (const string &type: newTypes) {
+			typesKey = typesKey * 31 + getTextHash(type, 0, getLength(type));
+		}
+	}
+}
+
+// Basic scan for scope level at each line
+//   Increments/decrements at each brace
+void StyleScanner::scanScopeLevels() {
+	braceLevels.resize(getSize(fileLines));
+	scanBraceLevels(0, getSize(fileLines), 0);
+	setScopeLevels();
+}
+
+// Scan brace levels (before each line) over a range of lines
+//   Starts from the given level; returns the level after the range.
+int StyleScanner::scanBraceLevels(int start, int end, int level) {
+	for (int i = start; i < end; i++) {
+		braceLevels[i] = level;
+		if (!commentLines[i]) {
+			for (char c: fileLines[i]) {
+				switch (c) {
+					case LEFT_BRACE: level++; break;
+					case RIGHT_BRACE: level--; break;
+				}
+			}
+		}
+	}
+	return level;
+}
+
+// Scan a line for a new type name
+void StyleScanner::scanNewTypeDef(int i) {
+	const auto &line = fileLines[i];
+	if (!isCommentLine(i) && isClassHeader(line)) {
+		int pos = 0;
+		int start = 0;
+		findNextToken(line, pos, start);
+		getNextToken(line, pos, scratchName);
+		addNewType(scratchName);
+		newTypeLines.push_back(windowStart + i);
+	}
+}
+
+// Add a new type name, reusing a spare string if there is one
+//   Spares return in the order they were cleared, so each keeps
+//   the capacity its place in the list needed before.
+void StyleScanner::addNewType(const string &name) {
+	if (spareTypes.empty()) {
+		newTypes.push_back(name);
+		spareTypes.reserve(newTypes.capacity());
+	}
+	else {
+		newTypes.push_back(move(spareTypes.back()));
+		spareTypes.pop_back();
+		newTypes.back().assign(name);
+	}
+}
+
+// Clear the new type names, keeping their strings as spares
+void StyleScanner::clearNewTypes() {
+	spareTypes.reserve(getSize(spareTypes) + getSize(newTypes));
+	while (!newTypes.empty()) {
+		spareTypes.push_back(move(newTypes.back()));
+		newTypes.pop_back();
+	}
+}
+
+// Set scope levels from brace levels
+void StyleScanner::setScopeLevels() {
+	scopeLevels.resize(getSize(fileLines));
+	for (int i = 0; i < getSize(fileLines); i++) {
+		setScopeLevel(i);
+	}
+}
+
+// Set a line's scope level from its brace level
+void StyleScanner::setScopeLevel(int i) {
+	scopeLevels[i] = braceLevels[i];
+
+	// Adjust current line back for first closure
+	if (!commentLines[i] && isLineStartCloseBrace(fileLines[i])) {
+		scopeLevels[i]--;
+	}
+}
+
+// Apply an edit to the scanned file, updating prescan data
+//   Replaces numOld lines at start with newLines.
+//   Comments & braces are rescanned only from the edit until the
+//   comment map agrees with the old scan; brace levels after that
+//   just shift by the change in level. Scope levels & new types are
+//   redone only where the edit can change them.
+void StyleScanner::applyEdit(int start, int numOld,
+	const vector<string> &newLines)
+{
+	assert(0 <= start && numOld >= 0
+		&& start + numOld <= getSize(fileLines));
+	int startLevel = getBraceLevelBefore(start);
+	spliceLines(start, numOld, newLines);
+	int end = rescanComments(start, start + getSize(newLines));
+	int delta = rescanBraceLevels(start, end, startLevel);
+	rescanScopeLevels(start, end, delta);
+	rescanNewTypes(start, end - getSize(newLines) + numOld, end);
+}
+
+// Rescan brace levels over changed lines, & shift those after
+//   Returns the change in level for the lines after.
+int StyleScanner::rescanBraceLevels(int start, int end, int startLevel) {
+	int endLevel = scanBraceLevels(start, end, startLevel);
+	int delta = 0;
+	if (end < getSize(fileLines)) {
+		delta = endLevel - braceLevels[end];
+	}
+	for (int i = end; delta != 0 && i < getSize(fileLines); i++) {
+		braceLevels[i] += delta;
+	}
+	return delta;
+}
+
+// Rescan scope levels & labels after an edit
+//   Lines past the changed ones are redone only while their scope
+//   depends on the edit: to the end if brace levels shifted, or
+//   else until the label state matches the old scan.
+void StyleScanner::rescanScopeLevels(int start, int end, int delta) {
+	int labelLevel = start > 0 ? labelLevels[start - 1] : 0;
+	for (int i = start; i < getSize(fileLines); i++) {
+		int oldLabelLevel = labelLevels[i];
+		setScopeLevel(i);
+		labelLevel = scanScopeLabel(i, labelLevel);
+		labelLevels[i] = labelLevel;
+		if (i >= end && delta == 0 && labelLevel == oldLabelLevel) {
+			return;
+		}
+	}
+}
+
+// Rescan new type names on changed lines, from start to end
+//   Types are kept in line order, so those after the change (from
+//   oldEnd, before the edit) are set aside & added back shifted.
+void StyleScanner::rescanNewTypes(int start, int oldEnd, int end) {
+	int first = lower_bound(newTypeLines.begin(), newTypeLines.end(),
+		start) - newTypeLines.begin();
+	int last = lower_bound(newTypeLines.begin(), newTypeLines.end(),
+		oldEnd) - newTypeLines.begin();
+	vector<string> laterTypes(newTypes.begin() + last, newTypes.end());
+	vector<int> laterLines(newTypeLines.begin() + last,
+		newTypeLines.end());
+	newTypes.resize(first);
+	newTypeLines.resize(first);
+	for (int i = start; i < end; i++) {
+		scanNewTypeDef(i);
+	}
+	for (int i = 0; i < getSize(laterTypes); i++) {
+		newTypes.push_back(laterTypes[i]);
+		newTypeLines.push_back(laterLines[i] + end - oldEnd);
+	}
+	keyNewTypes();
+}
+
+// Get the brace level before a line (or after the last line)
+int StyleScanner::getBraceLevelBefore(int line) {
+	if (line < getSize(fileLines)) {
+		return braceLevels[line];
+	}
+	int last = getSize(fileLines) - 1;
+	return last < 0 ? 0 : scanBraceLevels(last, last + 1, braceLevels[last]);
+}
+
+// Replace lines in the file & per-line prescan data
+//   New lines get placeholder prescan data until rescanned.
+void StyleScanner::spliceLines(int start, int numOld,
+	const vector<string> &newLines)
+{
+	int numNew = getSize(newLines);
+	fileLines.erase(fileLines.begin() + start,
+		fileLines.begin() + start + numOld);
+	fileLines.insert(fileLines.begin() + start,
+		newLines.begin(), newLines.end());
+	spliceLevels(commentLines, start, numOld, numNew);
+	spliceLevels(braceLevels, start, numOld, numNew);
+	spliceLevels(scopeLevels, start, numOld, numNew);
+	spliceLevels(labelLevels, start, numOld, numNew);
+}
+
+// Replace a range of per-line prescan data with placeholders
+//   Zero is also NO_COMMENT, for the comment map.
+void StyleScanner::spliceLevels(vector<int> &levels, int start,
+	int numOld, int numNew)
+{
+	levels.erase(levels.begin() + start,
+		levels.begin() + start + numOld);
+	levels.insert(levels.begin() + start, numNew, 0);
+}
+
+// Rescan comment lines after an edit
+//   Starts after the last non-comment line before the edit, where
+//   we cannot be in a C-style comment. Stops past the edit end at a
+//   line that was & still is code, since all later lines then
+//   scan the same as before. Returns the line after the last rescanned.
+int StyleScanner::rescanComments(int start, int editEnd) {
+	while (start > 0 && commentLines[start - 1] != NO_COMMENT) {
+		start--;
+	}
+	bool inCstyleComment = false;
+	for (int i = start; i < getSize(fileLines); i++) {
+		int oldType = commentLines[i];
+		inCstyleComment = scanCommentLine(i, inCstyleComment);
+		if (i >= editEnd && oldType == NO_COMMENT
+			&& commentLines[i] == NO_COMMENT)
+		{
+			return i + 1;
+		}
+	}
+	return getSize(fileLines);
+}
+
+// Increment scope levels within labels
+//   Assumes basic scope levels set first
+//   Note labels only legitmate at scope level 1+.
+void StyleScanner::scanScopeLabels() {
+	labelLevels.resize(getSize(fileLines));
+	int labelLevel = 0;
+	for (int i = 0; i < getSize(fileLines); i++) {
+		labelLevel = scanScopeLabel(i, labelLevel);
+		labelLevels[i] = labelLevel;
+	}
+}
+
+// Increment a line's scope level if within a label
+//   Takes & returns the scope level of the current label (0 if none).
+int StyleScanner::scanScopeLabel(int i, int labelLevel) {
+	bool thisLineLabel = !commentLines[i] 
+		&& isLineLabel(fileLines[i]);
+	if (!labelLevel) {
+		if (thisLineLabel) {
+			labelLevel = scopeLevels[i];		
+		}
+	}
+	else {
+		if (scopeLevels[i] < labelLevel) {
+			labelLevel = 0;
+		}
+		else if (!thisLineLabel) {
+			scopeLevels[i]++;
+		}
+	}
+	return labelLevel;
+}
+
+// Print basic error
+void StyleScanner::printError(const char *error) {
+	if (isCollecting) {
+		diagnostics.push_back({0, 0, error});
+		return;
+	}
+	if (doSummary) {
+		summary.addError(error, 1);
+	}
+	cout << error << "\n";
+}
+
+// Format an error report with line numbers
+//   Reports, then clears, the error lines collected by a check.
+//   If no lines were collected, then nothing is printed.
+//   Line numbers are incremented for user display.
+void StyleScanner::printErrors(const char *error) {
+
+	// Flag any errors (in a streamed file, those kept for the rule)
+	if (isStreaming && keepStreamErrors()) return;
+	if (errorLines.size() > 0) {
+		anyErrors = true;	
+		if (doSummary) summary.addError(error, errorLines.size());
+	}
+	if (isCollecting) return collectErrors(error);
+	printErrorLines(error);
+	errorLines.clear();
+}
+
+// Print an error with its first few line numbers
+void StyleScanner::printErrorLines(const char *error) {
+
+	// Singular error
+	if (errorLines.size() == 1) {
+		cout << error << " (line " << errorLines[0] + 1 << ").\n";
+	}
+
+	// Multiple errors
+	else if (errorLines.size() > 1) {
+		cout << error << " (lines " << errorLines[0] + 1;
+		for (int i = 1; i < errorLines.size() && i < MAX_SHOWN; i++) {
+			cout << ", " << errorLines[i] + 1;
+		}
+		if (errorLines.size() > MAX_SHOWN) {
+			cout << ", etc";
+		}
+		cout << ").\n";
+	}
+}
+
+// Print success message if no errors found.
+void StyleScanner::checkNoErrors() {
+	if (!anyErrors && !isCollecting) {
+		cout << "No errors found.\n";	
+	}
+}
+
+// Flag an error line, unless it matches the starter baseline
+void StyleScanner::flagLine(int line) {
+	if (!isBaselineLine(line)) {
+		errorLines.add(line);
+	}
+}
+
+// Is this line exempt from reports (starter code, or not in a diff)?
+bool StyleScanner::isBaselineLine(int line) {
+	return line < getSize(baselineLines) && baselineLines[line];
+}
+
+// Flag an error line for a span of lines (e.g., a function)
+//   Skipped only if the whole span matches the starter baseline,
+//   so a starter function a student has lengthened is still flagged.
+void StyleScanner::flagRange(int first, int last, int line) {
+	for (int i = first; i <= last; i++) {
+		if (!isBaselineLine(i)) {
+			errorLines.add(line);
+			return;
+		}
+	}
+}
+
+// Check a line-local rule on every line
+void StyleScanner::checkLineRule(int rule, const char *error) {
+	for (int i = 0; i < getSize(fileLines); i++) {
+		if (!isBaselineLine(i) && hasLineError(rule, i)) {
+			errorLines.add(i);
+		}
+	}
+	printErrors(error);
+}
+
+// Does a line break a line-local rule?
+//   Uses memoized verdicts if available.
+bool StyleScanner::hasLineError(int rule, int line) {
+	if (lineVerdicts.empty()) {
+		return isLineError(rule, line);
+	}
+	return (lineVerdicts[line] >> rule) & 1;
+}
+
+// Evaluate a line-local rule on a line
+bool StyleScanner::isLineError(int rule, int line) {
+	switch (rule) {
+		case RULE_TAB_USAGE: return !isIndentTabs(line);
+		case RULE_LINE_LENGTH: return isLongLine(line);
+		case RULE_VARIABLE_NAMES: return isBadVariableLine(line);
+		case RULE_CONSTANT_NAMES: return isBadConstantLine(line);
+		case RULE_FUNCTION_NAMES: return isBadFunctionLine(line);
+		case RULE_PUNCTUATION_SPACING: return isBadPunctuationLine(line);
+		case RULE_SPACED_OPERATORS: return isBadOperatorLine(line);
+		case RULE_START_SPACE_COMMENTS: return isBadCommentStartLine(line);
+		case RULE_ENDLINE_COMMENTS: return isEndlineCommentLine(line);
+		default: assert(false); return false;
+	}
+}
+
+// Evaluate all line-local rules on a line, as a bit mask by rule
+unsigned StyleScanner::getLineVerdicts(int line) {
+	unsigned verdicts = 0;
+	for (int rule: LINE_RULES) {
+		if (isLineError(rule, line)) {
+			verdicts |= 1u << rule;
+		}
+	}
+	return verdicts;
+}
+
+// Get line-local verdicts for all lines, reusing any seen before
+//   Many lines recur across a batch (includes, boilerplate, braces),
+//   so each distinct line & context is evaluated once per batch.
+//   The memo is cleared when the profile changes.
+//   With a function cache, whole functions are looked up first.
+void StyleScanner::memoLineVerdicts() {
+	lineVerdicts.clear();
+	if (!doMemo && cacheFile.empty()) {
+		return;
+	}
+	int numLines = getSize(fileLines);
+	lineVerdicts.resize(numLines);
+	lineKeys.resize(numLines);
+	for (int i = 0; i < numLines; i++) {
+		lineKeys[i] = getVerdictKey(i);
+	}
+	for (int i = 0; i < numLines; i++) {
+		if (!cacheFile.empty() && isFunctionStart(i)) {
+			i = cacheFunctionVerdicts(i);
+		}
+		else {
+			lineVerdicts[i] = getMemoVerdicts(i);
+		}
+	}
+}
+
+// Get line-local verdicts for one line, from the memo if on
+unsigned StyleScanner::getMemoVerdicts(int line) {
+	if (!doMemo) {
+		return getLineVerdicts(line);
+	}
+	auto found = verdictMemo.find(lineKeys[line]);
+	bool isHit = found != verdictMemo.end();
+	metrics.recordMemo(isHit ? 1 : 0, 1);
+	if (isHit) {
+		return found->second;
+	}
+	unsigned verdicts = getLineVerdicts(line);
+	if (verdictMemo.size() < MAX_MEMO_ENTRIES) {
+		verdictMemo[lineKeys[line]] = verdicts;
+	}
+	return verdicts;
+}
+
+// Does a function start on this line?
+bool StyleScanner::isFunctionStart(int line) {
+	return !commentLines[line] && isFunctionHeader(fileLines[line]);
+}
+
+// Get line-local verdicts for a function, from the cache if there
+//   Key is all the function's line keys & the line length limit,
+//   so any edit inside the function (or to its scope) is a miss.
+//   Returns the last line of the function.
+int StyleScanner::cacheFunctionVerdicts(int start) {
+	int end = start + countFunctionLength(start);
+	size_t key = profile.maxLineLength;
+	for (int i = start; i <= end; i++) {
+		key = key * 1000003u ^ lineKeys[i];
+	}
+	auto found = functionCache.find(key);
+	bool isHit = found != functionCache.end()
+		&& (int) found->second.verdicts.size() == end - start + 1;
+	metrics.recordFunctionCache(isHit ? 1 : 0, 1);
+	if (isHit) {
+		copy(found->second.verdicts.begin(), found->second.verdicts.end(),
+			lineVerdicts.begin() + start);
+		found->second.age = 0;
+		return end;
+	}
+	for (int i = start; i <= end; i++) {
+		lineVerdicts[i] = getMemoVerdicts(i);
+	}
+
+	// Cache the new verdicts, if there's room
+	if (hasFunctionCacheRoom()) {
+		functionCache[key] = {vector<unsigned>(lineVerdicts.begin() + start,
+			lineVerdicts.begin() + end + 1), 0};
+	}
+	return end;
+}
+
+// Is there room to add a function to the cache?
+//   When full, entries unused this run are dropped to make room.
+bool StyleScanner::hasFunctionCacheRoom() {
+	if (functionCache.size() < MAX_CACHED_FUNCTIONS) {
+		return true;
+	}
+	auto entry = functionCache.begin();
+	while (entry != functionCache.end()) {
+		entry = entry->second.age > 0 ? functionCache.erase(entry) : next(entry);
+	}
+	return functionCache.size() < MAX_CACHED_FUNCTIONS;
+}
+
+// Load the function cache file, if any
+//   A missing file is an empty cache (e.g., on first use);
+//   a file of another format is ignored. Entries age by one run,
+//   & those unused for MAX_CACHE_AGE runs are dropped.
+void StyleScanner::loadFunctionCache() {
+	ifstream inFile(cacheFile);
+	string header;
+	if (!getline(inFile, header) || header != FUNCTION_CACHE_HEADER) {
+		return;
+	}
+	uint64_t fileBytes = getRemainingBytes(inFile);
+	size_t key;
+	CachedFunction entry;
+	int numLines;
+	while (functionCache.size() < MAX_CACHED_FUNCTIONS
+		&& inFile >> hex >> key >> entry.age >> numLines)
+	{
+
+		// Each verdict takes at least 2 bytes, so bound the count by that
+		if (numLines < 0 || (uint64_t) numLines > fileBytes / 2) {
+			return;
+		}
+		entry.verdicts.resize(numLines);
+		for (unsigned &lineVerdict: entry.verdicts) {
+			inFile >> lineVerdict;
+		}
+		if (inFile && ++entry.age <= MAX_CACHE_AGE) {
+			functionCache[key] = entry;
+		}
+	}
+}
+
+// Save the function cache file
+//   Written to a temporary first, like the metrics file.
+void StyleScanner::writeFunctionCache() {
+	if (cacheFile.empty()) {
+		return;
+	}
+	string tempName = getTempName(cacheFile);
+	ofstream outFile(tempName);
+	outFile << FUNCTION_CACHE_HEADER << "\n" << hex;
+	for (const auto &entry: functionCache) {
+		outFile << entry.first << " " << entry.second.age
+			<< " " << entry.second.verdicts.size();
+		for (unsigned lineVerdict: entry.second.verdicts) {
+			outFile << " " << lineVerdict;
+		}
+		outFile << "\n";
+	}
+	outFile.close();
+	#ifdef _WIN32
+	remove(cacheFile.c_str());
+	#endif
+	rename(tempName.c_str(), cacheFile.c_str());
+}
+
+// Get memo key for a line: its text & the context its rules use
+//   (comment type, scope level, & whether it may continue the last line).
+size_t StyleScanner::getVerdictKey(int line) {
+	size_t key = getTextHash(fileLines[line], 0, getLength(fileLines[line]));
+	key = key * 31 + commentLines[line];
+	key = key * 31 + typesKey;
+	key = key * 1000003u + scopeLevels[line];
+	return key * 2 + mayBeRunOnLine(line);
+}
+
+// Mark lines in runs that match the starter baseline
+void StyleScanner::markBaselineLines() {
+	baselineLines.clear();
+	if (diffMode) {
+		markDiffLines();
+	}
+	if (baselineSpans.empty()) {
+		return;
+	}
+	int numLines = getSize(fileLines);
+	baselineLines.resize(numLines, 0);
+	lineHashes.resize(numLines);
+	for (int i = 0; i < numLines; i++) {
+		lineHashes[i] = getLineHash(fileLines[i]);
+	}
+	for (int i = 0; i + BASELINE_SPAN <= numLines; i++) {
+		if (baselineSpans.count(getSpanHash(lineHashes, i)) > 0) {
+			fill_n(baselineLines.begin() + i, BASELINE_SPAN, 1);
+		}
+	}
+}
+
+// Mark the lines a diff left unchanged, so only added lines report
+void StyleScanner::markDiffLines() {
+	baselineLines.assign(getSize(fileLines), 1);
+	for (int line: diffLines[fileName]) {
+		if (line < getSize(baselineLines)) {
+			baselineLines[line] = 0;
+		}
+	}
+}
+
+// Load changed lines & files from a unified diff
+//   The diff comes from standard input, or from git's staged changes
+//   (as for a pre-commit hook, run at the top of the work tree).
+bool StyleScanner::loadDiffFiles() {
+	if (!gitDiffMode) {
+		readDiff(cin);
+		return true;
+	}
+	#ifdef __unix__
+	FILE *pipe = popen("git diff --cached -U0 --no-color --no-ext-diff", "r");
+	if (pipe == nullptr) {
+		return false;
+	}
+	PipeBuf pipeBuf(pipe);
+	istream inPipe(&pipeBuf);
+	readDiff(inPipe);
+	return pclose(pipe) == 0;
+	#else
+	cerr << "Error: Reading git changes needs a unix system.\n";
+	return false;
+	#endif
+}
+
+// Read the added lines of each source file in a unified diff
+//   Source files with added lines join the batch, in diff order.
+void StyleScanner::readDiff(istream &in) {
+	string line;
+	string previous;
+	string path;
+	int newLine = 0;
+	while (getline(in, line)) {
+		if (line.compare(0, 4, "+++ ") == 0
+			&& previous.compare(0, 4, "--- ") == 0)
+		{
+			path = getDiffPath(line.substr(4));
+		}
+		else if (line.compare(0, 3, "@@ ") == 0) {
+			newLine = atoi(line.c_str() + line.find(" +") + 2) - 1;
+		}
+		else if (!path.empty() && !line.empty() && line[0] == '+') {
+			if (diffLines[path].empty()) {
+				fileNames.push_back(path);
+			}
+			diffLines[path].push_back(newLine++);
+		}
+		else if (!line.empty() && line[0] == ' ') {
+			newLine++;
+		}
+		previous = line;
+	}
+}
+
+// Get a source file path from a diff's new file header
+//   Drops git's b/ prefix & any timestamp; a deleted or non-source
+//   file gives an empty path.
+string StyleScanner::getDiffPath(const string &header) {
+	string path = header.substr(0, header.find('\t'));
+	if (path.compare(0, 2, "b/") == 0) {
+		path.erase(0, 2);
+	}
+	return isSourceName(path) ? path : "";
+}
+
+// Read text for the current file name: file, stdin, or git index
+//   A zstd file is read through a zstd process, which runs ahead
+//   decompressing while the text is read.
+bool StyleScanner::readNamedText() {
+	if (fileName == "-") {
+		return readStreamText(cin);
+	}
+	if (endsWith(fileName, ".zst")) {
+		return readCommandText("zstd -dcq < " + shellQuote(fileName));
+	}
+	return gitDiffMode ? readStagedText() : readFileText();
+}
+
+// Read the staged (git index) version of the current file
+//   Line numbers in a staged diff refer to this version.
+bool StyleScanner::readStagedText() {
+	return readCommandText("git show :" + shellQuote(fileName));
+}
+
+// Read the output of a shell command as the file text
+//   Fails if the command fails (e.g., for a missing file).
+bool StyleScanner::readCommandText(const string &command) {
+	#ifdef __unix__
+	string quietCommand = "(" + command + ") 2>/dev/null";
+	FILE *pipe = popen(quietCommand.c_str(), "r");
+	if (pipe == nullptr) {
+		return false;
+	}
+	PipeBuf pipeBuf(pipe);
+	istream inPipe(&pipeBuf);
+	bool isRead = readStreamText(inPipe);
+	return pclose(pipe) == 0 && isRead;
+	#else
+	cerr << "Error: Reading through a command needs a unix system.\n";
+	return false;
+	#endif
+}
+
+// Does this text start with a gzip header?
+bool StyleScanner::isGzipData(const string &text) {
+	return text.compare(0, 2, "\x1F\x8B") == 0;
+}
+
+// Decompress gzip file text in place, with the built-in inflater
+//   Checks the CRC & size trailer (so reads one gzip member only);
+//   the size is the original modulo 2^32, so only checked afterward.
+bool StyleScanner::inflateGzipText() {
+	size_t start = getGzipDataStart(fileText);
+	if (start == string::npos) {
+		return false;
+	}
+	archiveText.swap(fileText);
+	size_t end = archiveText.size() - 8;
+	size_t size = getLittleEndian(archiveText, end + 4, 4);
+	bool isOk = inflater.inflate(archiveText.data() + start, end - start,
+		fileText, string::npos) && (uint32_t) fileText.size() == size
+		&& getCrc32(fileText) == getLittleEndian(archiveText, end, 4);
+	archiveText.clear();
+	return isOk;
+}
+
+// Find the deflate data in gzip text, past its header (RFC 1952)
+//   Skips any extra field, file name, comment, & header CRC;
+//   returns npos for a bad header.
+size_t StyleScanner::getGzipDataStart(const string &data) {
+	if (data.size() < GZIP_HEADER_SIZE + 8 || data[2] != 8) {
+		return string::npos;
+	}
+	int flags = data[3];
+	size_t pos = GZIP_HEADER_SIZE;
+	if (flags & 4) {
+		pos += 2 + getLittleEndian(data, pos, 2);
+	}
+	if (flags & 8) {
+		pos = skipGzipString(data, pos);
+	}
+	if (flags & 16) {
+		pos = skipGzipString(data, pos);
+	}
+	if (pos != string::npos && (flags & 2)) {
+		pos += 2;
+	}
+	return pos != string::npos && pos + 8 <= data.size() ? pos : string::npos;
+}
+
+// Skip a NUL-terminated gzip header string
+size_t StyleScanner::skipGzipString(const string &data, size_t pos) {
+	if (pos >= data.size()) {
+		return string::npos;
+	}
+	size_t end = data.find('\0', pos);
+	return end == string::npos ? end : end + 1;
+}
+
+// Hash a line, ignoring trailing whitespace
+size_t StyleScanner::getLineHash(const string &line) {
+	int end = getLength(line);
+	while (end > 0 && isspace(line[end - 1])) {
+		end--;
+	}
+	return getTextHash(line, 0, end);
+}
+
+// Hash characters start to end of a string (FNV-1a)
+size_t StyleScanner::getTextHash(const string &s, int start, int end) {
+	size_t hash = 2166136261u;
+	for (int i = start; i < end; i++) {
+		hash = (hash ^ (unsigned char) s[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// Hash a run of BASELINE_SPAN line hashes
+size_t StyleScanner::getSpanHash(const vector<size_t> &hashes, int start) {
+	size_t hash = 0;
+	for (int i = start; i < start + BASELINE_SPAN; i++) {
+		hash = hash * 1000003u ^ hashes[i];
+	}
+	return hash;
+}
+
+// Does a run of BASELINE_SPAN lines have any word characters?
+bool StyleScanner::hasWordChars(const vector<string> &lines, int start) {
+	for (int i = start; i < start + BASELINE_SPAN; i++) {
+		for (char c: lines[i]) {
+			if (isalnum(c)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Get index of first comment line
+//   Returns -1 if none whatsoever
+//   In a streamed file, it is found as lines are read, & may be
+//   before the window (so negative).
+int StyleScanner::getFirstCommentLine() {
+	if (isStreaming) {
+		return stream.firstComment < 0 ? -1
+			: stream.firstComment - windowStart;
+	}
+	for (int i = 0; i < getSize(fileLines); i++) {
+		if (commentLines[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Check if the file has any comment lines at all
+void StyleScanner::checkAnyComments() {
+	if (getFirstCommentLine() == -1) {
+		printError("No comments found!");
+	}
+}
+
+// Check header start
+//   File should start with a comment
+void StyleScanner::checkHeaderStart() {
+	if (getFirstCommentLine() != 0 && !isBaselineLine(0)) {
+		printError("No comment on first line! (line 1).");
+	}
+}
+
+// Check file header
+void StyleScanner::checkHeaderFormat() {
+	static const string HEADER[] = {C_COMMENT_START, "Name:", "Copyright:",
+		"Author:", "Date:", "Description:"};
+	int currLine = getFirstCommentLine();
+	if (currLine >= 0) {
+		for (const string &headPrefix: HEADER) {
+			if (currLine >= getSize(fileLines)) {
+				flagLine(currLine);
+			}
+			else {
+				const auto &thisLine = fileLines[currLine];
+				unsigned int startIdx = getFirstNonspacePos(thisLine);
+				if (thisLine.find(headPrefix, startIdx) != startIdx) {
+					flagLine(currLine);
+				}
+			}
+			currLine++;
+		}
+	}
+	printErrors("Invalid comment header!");
+}
+
+// Check line lengths
+void StyleScanner::checkLineLength() {
+	checkLineRule(RULE_LINE_LENGTH, "Line is too long");
+}
+
+// Is this line too long?
+bool StyleScanner::isLongLine(int line) {
+	return getLength(fileLines[line]) > profile.maxLineLength;
+}
+
+// How many tabs are at the start of this line?
+int StyleScanner::getStartTabCount(const string &line) {
+	int count = 0;
+	while (count < getLength(line) && line[count] == '\t')
+		count++;
+	return count;
+}
+
+// Is the indent in this line using tabs?
+bool StyleScanner::isIndentTabs(int line) {
+	const auto &lineStr = fileLines[line];	
+	int checkToPos = getFirstNonspacePos(lineStr);
+
+	// Artistic Style uses spaces for continuation lines;
+	// so in these cases, check no further than scope level
+	if (mayBeRunOnLine(line)) {
+		checkToPos = min(checkToPos, scopeLevels[line]);
+	}
+	
+	// Check for all-tabs here
+	for (int i = 0; i < checkToPos; i++) {
+		if (lineStr[i] != '\t') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Check endline comments
+void StyleScanner::checkEndlineComments() {
+	checkLineRule(RULE_ENDLINE_COMMENTS,
+		"Endline comments should not be used");
+}
+
+// Does this code line have a comment at the end?
+bool StyleScanner::isEndlineCommentLine(int line) {
+	return !commentLines[line]
+		&& (fileLines[line].find(DOUBLE_SLASH) != string::npos
+		|| fileLines[line].find(C_COMMENT_START) != string::npos);
+}
+
+// Check tab usage for indents
+void StyleScanner::checkTabUsage() {
+	checkLineRule(RULE_TAB_USAGE, "Tabs should be used for indents");
+}
+
+// Is this line in the middle of a C-style block comment?
+bool StyleScanner::isMidBlockComment(int line){
+	return commentLines[line] == C_COMMENT
+		&& (line > 0 && commentLines[line - 1] == C_COMMENT)
+		&& (line < getSize(commentLines) - 1 
+			&& commentLines[line + 1] == C_COMMENT);
+}
+
+// Is this line possibly a run-on (continuation) statement?
+bool StyleScanner::mayBeRunOnLine(int line) {
+	if (line > 0 && scopeLevels[line] == scopeLevels[line - 1]
+		&& !commentLines[line - 1] && !isBlank(line - 1))
+	{
+		const auto &priorLine = fileLines[line - 1];
+		int lastPriorChar = getLastNonspacePos(priorLine);
+		if (priorLine[lastPriorChar] != SEMICOLON) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Is this line at an acceptable indent level?
+bool StyleScanner::isOkayIndentLevel(int line) {
+
+	// Ignore some cases
+	if (isBlank(line) || isMidBlockComment(line) || !isIndentTabs(line)) {
+		return true;
+	}
+
+	// Get scope & tab levels
+	int scopeLevel = scopeLevels[line];
+	int numStartTabs = getStartTabCount(fileLines[line]);
+
+	// Comments before a case permit one less indent (sketchy at first)
+	if (isCommentBeforeCase(line)) {
+		return numStartTabs	== scopeLevel
+			|| numStartTabs == scopeLevel - 1;
+	}
+
+	// Run-on (continuation) lines handling:
+	//   Artistic Style uses spaces, so require at least scope tabs
+	if (mayBeRunOnLine(line)) {
+		return numStartTabs >= scopeLevel;
+	}
+
+	// Standard indent case
+	return numStartTabs == scopeLevel;
+}
+
+// Check indent levels
+void StyleScanner::checkIndentLevels() {
+	for (int i = 0; i < getSize(fileLines); i++) {
+		if (!isOkayIndentLevel(i)) {
+			flagLine(i);
+		}
+	}
+	printErrors("Indent level errors");
+}
+
+// Check blanks before comments (required)
+void StyleScanner::checkBlanksBeforeComments() {
+	for (int i = 1; i < getSize(fileLines); i++) {
+		if (commentLines[i]
+			&& !commentLines[i - 1]
+			&& !isBlankOrBrace(i - 1))
+		{
+			flagLine(i);
+		}
+	}
+	printErrors("Missing blank line before comment");
+}
+
+// Check for no comments in long stretch of statements
+void StyleScanner::checkTooFewComments() {
+	const int LONG_STRETCH = profile.maxUncommentedLines;
+	for (int i = 0; i < getSize(fileLines); i++) {
+		if (commentLines[i]) {
+			int end = i + 1;
+			while (end < getSize(fileLines) && !commentLines[end++]);
+			int span = end - i - 2;
+			if (span > LONG_STRETCH) {
+				flagRange(i, end - 1, i + LONG_STRETCH / 2);
+			}
+			i = end;
+		}
+	}
+	printErrors("Too few comments");
+}
+
+// Check that next N lines all in same scope
+bool StyleScanner::isSameScope(int startLine, int numLines) {
+	if (startLine >= 0
+		&& startLine + numLines < getSize(fileLines))
+	{
+		int startLevel = scopeLevels[startLine];
+		for (int i = 1; i <= numLines; i++) {
+			if (scopeLevels[startLine + i] != startLevel) {
+				return false;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+// Check for commenting multiple single-line statements
+void StyleScanner::checkTooManyComments() {
+	for (int i = 0; i < getSize(fileLines) - 5; i++) {
+		if (commentLines[i]
+			&& !commentLines[i + 1]
+			&& isBlank(i + 2)
+			&& commentLines[i + 3]
+			&& !commentLines[i + 4]
+			&& isBlank(i + 5)
+			&& isSameScope(i, 5))
+		{
+			flagLine(i + 3);
+		}
+	}
+	printErrors("Too many comments");
+}
+
+// Is this character an operator that expects spacing?
+//    Note we must skip many symbols used for other purposes, e.g.:
+//   '<', '>' used for brackets in #includes, templates
+//   "++", "--" pre/postfix to variable
+//   "+" used in name of overloaded operator+
+//   "-" used for unary negation (start number)
+//   "*" used for pointer operator
+//   "/" used in units (e.g., ft/sec)
+bool StyleScanner::isSpacedOperator(const string &s) {
+	static const string SPACE_OPS[] = {"%", "<<", ">>", "<=", ">=",
+		"==", "!=", "&&", "||", "=", "+=", "-=", "*=", "/="};
+	for (const string &op: SPACE_OPS) {
+		if (s == op) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Check spaces around operators
+void StyleScanner::checkSpacedOperators() {
+	checkLineRule(RULE_SPACED_OPERATORS,
+		"Operators should have surrounding spaces");
+}
+
+// Does this line have an operator without surrounding spaces?
+bool StyleScanner::isBadOperatorLine(int i) {
+	if (!isCommentLine(i)) {
+		int pos = 0;
+		const auto &line = fileLines[i];
+		while (getNextToken(line, pos, scratchToken)) {
+			if (isSpacedOperator(scratchToken)) {
+
+				// Check for space before & after
+				int startPos = pos - scratchToken.length();
+				if ((startPos > 0 && !isspace(line[startPos - 1]))
+					|| (pos < getLength(line) && !isspace(line[pos])))
+				{
+					return true;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+// Check for endline C-style comments that continue to next line
+//   Never seen this, but it would foil all our other comment logic.
+void StyleScanner::checkEndlineRunonComments() {
+	for (int i = 1; i < getSize(fileLines); i++) {
+		if (!isCommentLine(i)
+			&& fileLines[i].find(C_COMMENT_START) != string::npos
+			&& fileLines[i].find(C_COMMENT_END) == string::npos)
+		{
+			flagLine(i);
+		}
+	}
+	printErrors("Endline run-on comments are very bad");
+}
+
+// Is this a punctuation character?
+//   Can't do colons, b/c of time, scope-resolution operator.
+//   Can't do question mark, b/c conventionally has space before.
+//   Commas in big numbers problematic (but retain check for now).
+bool StyleScanner::isPunctuation(char c) {
+	const char PUNCT[] = {COMMA, SEMICOLON};
+	for (char punct: PUNCT) {
+		if (c == punct) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Is this an acceptable post-punctuation character?
+//   Quotes or escapes may follow in a string literal.
+bool StyleScanner::isPunctuationChaser(char c) {
+	const char CHASERS[] = {' ', '\n', '\t', '\"', '\\'};
+	for (char chaser: CHASERS) {
+		if (c == chaser) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Check for spaces after punctuation, but not before
+void StyleScanner::checkPunctuationSpacing() {
+	checkLineRule(RULE_PUNCTUATION_SPACING,
+		"Punctuation should have space afterward");
+}
+
+// Does this line have badly spaced punctuation?
+bool StyleScanner::isBadPunctuationLine(int i) {
+	const auto &line = fileLines[i];
+	for (int j = 0; j < getLength(line); j++) {
+		if (isPunctuation(line[j])) {
+			if (((j > 1 && isspace(line[j - 1]))
+				|| (j < getLength(line) - 1
+				&& !isPunctuationChaser(line[j + 1]))))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Get next token from a line
+//   Splits on spaces, identifiers, numbers, and punctuation.
+//   Simplistic: Gets blocks of punctuation, glues grouping symbols, etc.
+//   Starts at pos; updates pos to after found token.
+string StyleScanner::getNextToken(const string &s, int &pos) {
+	string token;
+	getNextToken(s, pos, token);
+	return token;
+}
+
+// Get next token from a line, into the given string
+//   Reuses the string's storage, so a long token need not allocate.
+//   Returns false if no token found (token is then empty).
+bool StyleScanner::getNextToken(const string &s, int &pos, string &token) {
+	int start = 0;
+	bool found = findNextToken(s, pos, start);
+	token.assign(s, start, pos - start);
+	return found;
+}
+
+// Find next token in a line, without copying it
+//   Starts at pos; sets start to token start, and pos to after it.
+//   Returns false if no token found.
+bool StyleScanner::findNextToken(const string &s, int &pos, int &start) {
+
+	// Eat spaces
+	while (pos < getLength(s) && isspace(s[pos])) {
+		pos++;
+	}
+
+	// Find token end
+	start = pos;
+	if (pos < getLength(s)) {
+		pos = findTokenEnd(s, pos);
+	}
+	return pos > start;
+}
+
+// Find token end from legitimate start position
+//   Can identify a word, number, or punctuation series
+int StyleScanner::findTokenEnd(const string &s, int pos) {
+	assert(pos < getLength(s));
+	assert(!isspace(s[pos]));
+	if (isalpha(s[pos]) || s[pos] == '_') {
+		while (pos < getLength(s) && (isalnum(s[pos]) || s[pos] == '_')) {
+			pos++;
+		}
+	}
+	else if (isdigit(s[pos])) {
+		while (pos < getLength(s) && (isdigit(s[pos]) || s[pos] == '.')) {
+			pos++;
+		}
+	}
+	else if (ispunct(s[pos])) {
+		while (pos < getLength(s) && ispunct(s[pos])) {
+			pos++;
+		}
+	}
+	return pos;
+}
+
+// Get first token on a line
+string StyleScanner::getFirstToken(const string &s) {
+	int pos = 0;
+	return getNextToken(s, pos);
+}
+
+// Get last token on a line
+string StyleScanner::getLastToken(const string &s) {
+	int pos = 0;
+	string lastToken = "";
+	string nextToken = getNextToken(s, pos);
+	while (nextToken != "") {
+		lastToken = nextToken;
+		nextToken = getNextToken(s, pos);
+	}
+	return lastToken;
+}
+
+// Is the first token on a line equal to string t?
+//   Compares in place, without copying the token.
+bool StyleScanner::isFirstToken(const string &s, const string &t) {
+	int pos = 0;
+	int start = 0;
+	findNextToken(s, pos, start);
+	return s.compare(start, pos - start, t) == 0;
+}
+
+// Does the first token on a line start with string t?
+bool StyleScanner::firstTokenStartsWith(const string &s, const string &t) {
+	int pos = 0;
+	int start = 0;
+	findNextToken(s, pos, start);
+	return pos - start >= getLength(t) && s.compare(start, t.length(), t) == 0;
+}
+
+// Does the last token on a line end with string t?
+bool StyleScanner::lastTokenEndsWith(const string &s, const string &t) {
+	int lastEnd = getLastNonspacePos(s) + 1;
+	int start = lastEnd - getLength(t);
+	return start >= 0 && s.compare(start, t.length(), t) == 0;
+}
+
+// Show all tokens in file (for testing)
+void StyleScanner::showTokens() {
+	for (const string &line: fileLines) {
+		int pos = 0;
+		string token = getNextToken(line, pos);
+		while (token != "") {
+			cout << token << "\n";
+			token = getNextToken(line, pos);
+		}
+		cout << "\n";
+	}
+	cout << "\n";
+}
+
+// Fingerprint the file's token stream & add it to the batch index
+//   Tokens are hashed with identifiers canonicalized (so renaming
+//   variables changes nothing), then grouped in overlapping runs of
+//   K_GRAM tokens, & winnowed to a small, position-robust subset.
+void StyleScanner::fingerprintFile() {
+	tokenHashes.clear();
+	for (int i = 0; i < getSize(fileLines); i++) {
+		if (!commentLines[i]) {
+			addTokenHashes(fileLines[i]);
+		}
+	}
+	gramHashes.clear();
+	for (int i = 0; i + K_GRAM <= (int) tokenHashes.size(); i++) {
+		size_t hash = 0;
+		for (int j = i; j < i + K_GRAM; j++) {
+			hash = hash * 1000003u ^ tokenHashes[j];
+		}
+		gramHashes.push_back(hash);
+	}
+	winnowFingerprints();
+	similarity.addFile(fileName, fingerprints);
+}
+
+// Add normalized token hashes for one line
+//   Identifiers (not keywords) & numbers each hash to one value.
+void StyleScanner::addTokenHashes(const string &line) {
+	const size_t IDENTIFIER_HASH = 1;
+	const size_t NUMBER_HASH = 2;
+	int pos = 0;
+	int start = 0;
+	while (findNextToken(line, pos, start)) {
+		size_t hash = getTextHash(line, start, pos);
+		if (isalpha(line[start]) || line[start] == '_') {
+			hash = isKeywordHash(hash) ? hash : IDENTIFIER_HASH;
+		}
+		else if (isdigit(line[start])) {
+			hash = NUMBER_HASH;
+		}
+		tokenHashes.push_back(hash);
+	}
+}
+
+// Is this the hash of a keyword (kept as is in fingerprints)?
+bool StyleScanner::isKeywordHash(size_t hash) {
+	static unordered_set<size_t> keywordHashes;
+	if (keywordHashes.empty()) {
+		for (const string &keyword: CPP_KEYWORDS) {
+			keywordHashes.insert(getTextHash(keyword, 0, getLength(keyword)));
+		}
+	}
+	return keywordHashes.count(hash) > 0;
+}
+
+// Winnow k-gram hashes to fingerprints
+//   Keeps the minimum hash of each window of WINNOW_WINDOW k-grams
+//   (rightmost if tied), once per position, so any shared run of
+//   K_GRAM + WINNOW_WINDOW - 1 tokens shares a fingerprint.
+void StyleScanner::winnowFingerprints() {
+	fingerprints.clear();
+	int numGrams = (int) gramHashes.size();
+	int window = min(WINNOW_WINDOW, numGrams);
+	int lastPick = -1;
+	for (int i = 0; i + window <= numGrams && window > 0; i++) {
+		int pick = i;
+		for (int j = i + 1; j < i + window; j++) {
+			pick = gramHashes[j] <= gramHashes[pick] ? j : pick;
+		}
+		if (pick != lastPick) {
+			fingerprints.push_back(gramHashes[pick]);
+			lastPick = pick;
+		}
+	}
+	sort(fingerprints.begin(), fingerprints.end());
+	auto last = unique(fingerprints.begin(), fingerprints.end());
+	fingerprints.erase(last, fingerprints.end());
+}
+
+// Finish a batch: summaries & saved cache
+void StyleScanner::finishBatch() {
+	printMemorySummary();
+	printMemoSummary();
+	writeFunctionCache();
+	printSimilarPairs();
+	printBatchSummary();
+}
+
+// Print the batch's aggregate summary, as text or JSON
+void StyleScanner::printBatchSummary() {
+	if (doSummary && isJsonSummary) {
+		summary.printJson();
+	}
+	else if (doSummary) {
+		summary.print();
+	}
+}
+
+// Print near-duplicate file pairs for the batch
+void StyleScanner::printSimilarPairs() {
+	if (similarPercent > 0) {
+		similarity.printPairs(similarPercent);
+	}
+}
+
+// Add a file's fingerprints (sorted, distinct) to the index
+void SimilarityIndex::addFile(const string &name,
+	const vector<size_t> &fingerprints)
+{
+	int file = (int) names.size();
+	names.push_back(name);
+	for (size_t fingerprint: fingerprints) {
+		postings[fingerprint].push_back(file);
+	}
+}
+
+// Print pairs sharing at least minPercent of fingerprints
+//   Fingerprints found in many files (e.g., starter code & common
+//   idioms) are skipped as boilerplate; this also bounds the work per
+//   fingerprint, so finding pairs is not quadratic in class size.
+//   Percent is of the smaller file's distinctive fingerprints.
+void SimilarityIndex::printPairs(int minPercent) {
+	int numFiles = (int) names.size();
+	int maxFiles = max(MIN_COMMON_FILES, numFiles / 10);
+	countShared(maxFiles);
+	countDistinct(maxFiles);
+	vector<pair<int, long long> > pairs;
+	for (const auto &entry: sharedCounts) {
+		int first = (int) (entry.first / numFiles);
+		int second = (int) (entry.first % numFiles);
+		int smaller = min(distinctCounts[first], distinctCounts[second]);
+		int percent = 100 * entry.second / max(smaller, 1);
+		if (percent >= minPercent) {
+			pairs.push_back({-percent, entry.first});
+		}
+	}
+	sort(pairs.begin(), pairs.end());
+	cout << "\nSimilar pairs (" << minPercent << "% or more shared):\n";
+	for (const auto &found: pairs) {
+		cout << names[found.second / numFiles] << " & "
+			<< names[found.second % numFiles] << ": "
+			<< -found.first << "%\n";
+	}
+	if (pairs.empty()) {
+		cout << "None found.\n";
+	}
+}
+
+// Count fingerprints shared by each pair of files
+//   Only pairs sharing some fingerprint are ever visited.
+void SimilarityIndex::countShared(int maxFiles) {
+	long long numFiles = (long long) names.size();
+	sharedCounts.clear();
+	for (const auto &entry: postings) {
+		const vector<int> &files = entry.second;
+		if ((int) files.size() <= maxFiles) {
+			for (int i = 0; i < (int) files.size(); i++) {
+				for (int j = i + 1; j < (int) files.size(); j++) {
+					sharedCounts[files[i] * numFiles + files[j]]++;
+				}
+			}
+		}
+	}
+}
+
+// Count each file's distinctive (not boilerplate) fingerprints
+void SimilarityIndex::countDistinct(int maxFiles) {
+	distinctCounts.assign(names.size(), 0);
+	for (const auto &entry: postings) {
+		if ((int) entry.second.size() <= maxFiles) {
+			for (int file: entry.second) {
+				distinctCounts[file]++;
+			}
+		}
+	}
+}
+
+// Record a rule's error in the current file, with lines flagged
+//   Rules are named by message, less any fixed line number; line
+//   counts are bucketed by powers of two (1, 2-3, 4-7, etc.).
+void BatchSummary::addError(const string &message, int numLines) {
+	string rule = message.substr(0, message.find(" (line"));
+	ruleFiles[rule]++;
+	vector<int> &buckets = ruleBuckets[rule];
+	int bucket = 0;
+	while (numLines >> (bucket + 1) > 0) {
+		bucket++;
+	}
+	if ((int) buckets.size() <= bucket) {
+		buckets.resize(bucket + 1);
+	}
+	buckets[bucket]++;
+	fileRules++;
+	fileLines += numLines;
+}
+
+// Finish a file's results: count it, & keep it if among the worst
+void BatchSummary::endFile(const string &name) {
+	numFiles++;
+	if (fileRules == 0) {
+		numClean++;
+	}
+	else {
+		FileScore score = {fileRules, fileLines, name};
+		worstFiles.insert(upper_bound(worstFiles.begin(), worstFiles.end(),
+			score, isWorse), score);
+		if ((int) worstFiles.size() > MAX_WORST_FILES) {
+			worstFiles.pop_back();
+		}
+	}
+	fileRules = 0;
+	fileLines = 0;
+}
+
+// Is one file's score worse (more rules, then more lines failed)?
+bool BatchSummary::isWorse(const FileScore &a, const FileScore &b) {
+	return a.numRules > b.numRules
+		|| (a.numRules == b.numRules && a.numLines > b.numLines);
+}
+
+// Print the summary as text
+void BatchSummary::print() {
+	cout << "\nBatch summary: " << numFiles << " files, " << numClean
+		<< " with no errors (" << getPercent(numClean) << "%).\n";
+	for (const auto &rule: getRulesByFiles()) {
+		cout << rule.second << ": " << rule.first << " files ("
+			<< getPercent(rule.first) << "%); lines per file:";
+		const vector<int> &buckets = ruleBuckets[rule.second];
+		for (int i = 0; i < (int) buckets.size(); i++) {
+			if (buckets[i] > 0) {
+				cout << " " << getBucketName(i) << " (" << buckets[i] << ")";
+			}
+		}
+		cout << "\n";
+	}
+	if (!worstFiles.empty()) {
+		cout << "Worst files:\n";
+	}
+	for (const FileScore &score: worstFiles) {
+		cout << "  " << score.name << ": " << score.numRules << " rules, "
+			<< score.numLines << " lines\n";
+	}
+}
+
+// Print the summary as one line of JSON
+void BatchSummary::printJson() {
+	string rules;
+	for (const auto &rule: getRulesByFiles()) {
+		rules += (rules.empty() ? "" : ", ") + getRuleJson(rule.second);
+	}
+	string worst;
+	for (const FileScore &score: worstFiles) {
+		worst += (worst.empty() ? "" : ", ") + jsonObject("\"file\": "
+			+ jsonQuote(score.name) + ", \"rules\": "
+			+ to_string(score.numRules) + ", \"lines\": "
+			+ to_string(score.numLines));
+	}
+	cout << jsonObject("\"files\": " + to_string(numFiles)
+		+ ", \"cleanFiles\": " + to_string(numClean)
+		+ ", \"cleanPercent\": " + to_string(getPercent(numClean))
+		+ ", \"rules\": [" + rules + "], \"worstFiles\": [" + worst + "]")
+		<< "\n";
+}
+
+// Get a rule's failing files & line count distribution as JSON
+string BatchSummary::getRuleJson(const string &rule) {
+	string buckets;
+	const vector<int> &counts = ruleBuckets[rule];
+	for (int i = 0; i < (int) counts.size(); i++) {
+		if (counts[i] > 0) {
+			buckets += (buckets.empty() ? "" : ", ") + jsonObject("\"lines\": "
+				+ jsonQuote(getBucketName(i)) + ", \"files\": "
+				+ to_string(counts[i]));
+		}
+	}
+	return jsonObject("\"rule\": " + jsonQuote(rule) + ", \"files\": "
+		+ to_string(ruleFiles[rule]) + ", \"linesPerFile\": ["
+		+ buckets + "]");
+}
+
+// Get the rules, most failed first
+vector<pair<int, string> > BatchSummary::getRulesByFiles() {
+	vector<pair<int, string> > rules;
+	for (const auto &rule: ruleFiles) {
+		rules.push_back(make_pair(-rule.second, rule.first));
+	}
+	sort(rules.begin(), rules.end());
+	for (auto &rule: rules) {
+		rule.first = -rule.first;
+	}
+	return rules;
+}
+
+// Name a line count bucket (a range between powers of two)
+string BatchSummary::getBucketName(int bucket) {
+	if (bucket == 0) {
+		return "1";
+	}
+	return to_string(1 << bucket) + "-" + to_string((2 << bucket) - 1);
+}
+
+// Get a count as a percent of files
+int BatchSummary::getPercent(int count) {
+	return numFiles > 0 ? (int) (100L * count / numFiles) : 0;
+}
+
+// Is this string a fundamental type?
+bool StyleScanner::isBasicType(const string &s) {
+	for (const string &type: BASIC_TYPES) {
+		if (s == type) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Does this line start with a fundamental type?
+//   Checks in place, without copying the first token.
+bool StyleScanner::startsWithBasicType(const string &s) {
+	for (const string &type: BASIC_TYPES) {
+		if (isFirstToken(s, type)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Is this string a new defined type in this file (or project)?
+bool StyleScanner::isNewType(const string &s) {
+	for (const string &t: newTypes) {
+		if (s == t)
+			return true;
+	}
+	return projectTypes.count(s) > 0;
+}
+
+// Does this line start declaring a variable of a defined type?
+//   Checked in project mode only, for plain & pointer variables.
+bool StyleScanner::startsWithProjectType(const string &s) {
+	if (!projectMode) {
+		return false;
+	}
+	int pos = 0;
+	if (!isNewType(getNextToken(s, pos))) {
+		return false;
+	}
+	string next = getNextToken(s, pos);
+	while (next == "*") {
+		next = getNextToken(s, pos);
+	}
+	return !next.empty() && (isalpha(next[0]) || next[0] == '_');
+}
+
+// Is this string any known type?
+bool StyleScanner::isAnyType(const string &s) {
+	return isBasicType(s) || isNewType(s);
+}
+
+// Is this string an acceptable constant name?
+bool StyleScanner::isOkConstant(const string &s) {
+	if (getLength(s) < 2) {
+		return false;
+	}
+	for (char c: s) {
+		if (!isupper(c) && c != '_') {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Check constant names
+void StyleScanner::checkConstantNames() {
+	checkLineRule(RULE_CONSTANT_NAMES, "Constants should be all-caps name");
+}
+
+// Does this line declare a badly named constant?
+bool StyleScanner::isBadConstantLine(int i) {
+	const auto &line = fileLines[i];
+	if (!isCommentLine(i) && isFirstToken(line, "const")) {
+		int pos = 0;
+		int start = 0;
+		findNextToken(line, pos, start);
+		getNextToken(line, pos, scratchToken);
+		if (isBasicType(scratchToken)) {
+			getNextToken(line, pos, scratchName);
+			return !isOkConstant(scratchName);
+		}
+	}
+	return false;
+}
+
+// Is this string an acceptable variable name?
+bool StyleScanner::isOkVariable(const string &s) {
+	if (getLength(s) < 2
+		|| !islower(s[0]))
+	{
+		return false;
+	}
+	for (int i = 1; i < getLength(s); i++) {
+		if (!isalnum(s[i])
+			|| (isupper(s[i]) && isupper(s[i - 1])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Does this token start with an open parenthesis?
+bool StyleScanner::isStartParen(const string &s) {
+	return getLength(s) > 0 && s[0] == '(';
+}
+
+// Does this symbol after an identifier indicate a function?
+bool StyleScanner::isFunctionSymbol(const string& symbol) {
+	return isStartParen(symbol)
+		|| symbol == "::"
+		|| symbol == "<";
+}
+
+// Check variable names
+//   Note we check only first variable declared on a line.
+void StyleScanner::checkVariableNames() {
+	checkLineRule(RULE_VARIABLE_NAMES, "Variables need full camelCase name");
+}
+
+// Does this line declare a badly named variable?
+bool StyleScanner::isBadVariableLine(int i) {
+	const auto &line = fileLines[i];
+	if (!isCommentLine(i)
+		&& (startsWithBasicType(line) || startsWithProjectType(line)))
+	{
+		int pos = 0;
+		string type = getNextToken(line, pos);
+
+		// Get the variable name
+		getNextToken(line, pos, scratchName);
+		while (scratchName == "*") {
+			getNextToken(line, pos, scratchName);
+		}
+
+		// Check only non-function names
+		getNextToken(line, pos, scratchToken);
+		return !isFunctionSymbol(scratchToken) && !isOkVariable(scratchName);
+	}
+	return false;
+}
+
+// Is this string an acceptable function name?
+//   Currently same rule as for variable names.
+bool StyleScanner::isOkFunction(const string &s) {
+	return isOkVariable(s);
+}
+
+// Check function names
+void StyleScanner::checkFunctionNames() {
+	checkLineRule(RULE_FUNCTION_NAMES, "Functions need full camelCase name");
+}
+
+// Does this line start a badly named function?
+bool StyleScanner::isBadFunctionLine(int i) {
+	return !isCommentLine(i) && isFunctionHeader(fileLines[i], scratchName)
+		&& !isOkFunction(scratchName);
+}
+
+// Is there a lead-in comment to the function here?
+bool StyleScanner::isLeadInCommentHere(int line) {
+
+	// No room for comment
+	if (line < 1)
+		return false;
+		
+	// Handle template prefix
+	if (isFirstToken(fileLines[line - 1], "template"))
+		return isLeadInCommentHere(line - 1);
+	
+	// Handle comment one line above
+	if (isCommentLine(line - 1))
+		return true;
+		
+	// Handle comment two lines above
+	if (line > 1
+			&& isBlank(line - 1)
+			&& isCommentLine(line - 2))
+		return true;
+	
+	// Failure
+	return false;
+}
+
+// Check for lead-in comments before functions
+void StyleScanner::checkFunctionLeadComments() {
+	if (doFunctionCommentCheck) {
+		for (int i = 0; i < getSize(fileLines); i++) {
+			if (!isCommentLine(i)
+				&& scopeLevels[i] == 0
+				&& isFunctionHeader(fileLines[i])
+				&& !isLeadInCommentHere(i)) 
+			{
+				flagLine(i);
+			}
+		}
+		printErrors("Functions should have a lead-in comment");
+	}
+}
+
+// Is the given line a function header?
+bool StyleScanner::isFunctionHeader(const string &s) {
+	int nameStart = 0;
+	int nameEnd = 0;
+	return findFunctionName(s, nameStart, nameEnd);
+}
+
+// Is the given line a function header?
+//   If so, return function name in parameter.
+bool StyleScanner::isFunctionHeader(const string &s, string &name) {
+	int nameStart = 0;
+	int nameEnd = 0;
+	if (findFunctionName(s, nameStart, nameEnd)) {
+		name.assign(s, nameStart, nameEnd - nameStart);
+		return true;
+	}
+	return false;
+}
+
+// Find the function name in a function header line
+//   Works on token positions, without copying tokens.
+//   Returns false if not a function header.
+bool StyleScanner::findFunctionName(const string &s, int &start, int &end) {
+	if (startsWithBasicType(s) && !isLineEndingSemicolon(s))
+	{
+		int pos = 0;
+		findNextToken(s, pos, start);
+		findNextToken(s, pos, start);
+		while (s.compare(start, pos - start, "*") == 0) {
+			findNextToken(s, pos, start);
+		}
+		end = pos;
+		int symbolStart = 0;
+		findNextToken(s, pos, symbolStart);
+		if (s.compare(symbolStart, pos - symbolStart, "::") == 0) {
+			findNextToken(s, pos, start);
+			end = pos;
+			findNextToken(s, pos, symbolStart);
+		}
+		return pos > symbolStart && s[symbolStart] == '(';
+	}
+	return false;
+}
+
+// Is this string an acceptable new type name?
+bool StyleScanner::isOkTypeName(const string &s) {
+	if (getLength(s) < 2
+		|| !isupper(s[0]))
+	{
+		return false;
+	}
+	for (int i = 1; i < getLength(s); i++) {
+		if (!isalnum(s[i])
+			|| (isupper(s[i]) && isupper(s[i - 1])))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Check class names
+void StyleScanner::checkClassNames() {
+	for (int i = 0; i < getSize(fileLines); i++) {
+		const auto &line = fileLines[i];
+		if (!isCommentLine(i) && isClassHeader(line)) {
+			int pos = 0;
+			int start = 0;
+			findNextToken(line, pos, start);
+			getNextToken(line, pos, scratchName);
+			if (!isOkTypeName(scratchName)) {
+				flagLine(i);
+			}
+		}
+	}
+	printErrors("Class/structs should start caps camel-case");
+}
+
+// Is this a class/struct header line?
+bool StyleScanner::isClassHeader(const string &s) {
+	return isFirstToken(s, "class") || isFirstToken(s, "struct");
+}
+
+// Is this the keyword for a class/struct?
+bool StyleScanner::isClassKeyword(const string &s) {
+	return s == "class" || s == "struct";
+}
+
+// Is this a preprocessor directive?
+bool StyleScanner::isPreprocessorDirective(const string &s) {
+	return isFirstToken(s, "#");
+}
+
+// Check extraneous blank lines
+//    Blank lines should only occur:
+//    before comment, label, function, class, or preprocessor directive
+void StyleScanner::checkExtraneousBlanks() {
+	for (int i = 0; i < (int) getSize(fileLines) - 2; i++) {
+		if (isBlank(i)) {
+			int next = i + 1;
+			const auto &nextLine = fileLines[next];
+			if (!commentLines[next]
+				&& !isLineLabel(nextLine)
+				&& !isFunctionHeader(nextLine)
+				&& !isClassHeader(nextLine)
+				&& !isPreprocessorDirective(nextLine))
+			{
+				flagLine(i);
+			}
+		}
+	}
+	printErrors("Extraneous blank lines");
+}
+
+// C++-style comments should have a space after slashes.
+void StyleScanner::checkStartSpaceComments() {
+	checkLineRule(RULE_START_SPACE_COMMENTS,
+		"Comments need space after slashes");
+}
+
+// Does this comment line lack a space after its slashes?
+bool StyleScanner::isBadCommentStartLine(int i) {
+	const auto &line = fileLines[i];
+	if (isFirstToken(line, DOUBLE_SLASH)) {
+		int pos = getFirstNonspacePos(line) + 2;
+		return pos < getLength(line) && !isspace(line[pos]);
+	}
+	return false;
+}
+
+// Check for overly long functions.
+void StyleScanner::checkFunctionLength() {
+	if (doFunctionLengthCheck) {
+		bool inClassHeader = false;
+		for (int i = 0; i < getSize(fileLines); i++) {
+			if (scopeLevels[i] == 0) {
+				inClassHeader = false;
+			}
+			if (!commentLines[i]) {
+				if (isClassHeader(fileLines[i])) {
+					inClassHeader = true;
+				}
+				if (isFunctionHeader(fileLines[i])) {
+					int length = countFunctionLength(i);
+					if (length > getFunctionLengthLimit(inClassHeader)) {
+						flagRange(i, i + length, i);
+					}
+				}
+			}
+		}
+		printErrors("Function is too long!");
+	}
+}
+
+// Get the relevant function length limit
+int StyleScanner::getFunctionLengthLimit(bool inClassHeader) {
+	return inClassHeader ? profile.maxInlineLength
+		: profile.maxFunctionLength;
+}
+
+// Count function length from header line
+int StyleScanner::countFunctionLength(int startLine) {
+	int startScope = scopeLevels[startLine];
+	int line = startLine + 1;
+	while (line < getSize(fileLines) &&
+		(isLineStartOpenBrace(fileLines[line])
+			|| scopeLevels[line] > startScope))
+	{
+		line++;
+	}
+	return line - startLine - 1;
+}
+
+// Print memory use by scan artifact for this file
+//   Counts container & string heap bytes, not allocator overhead.
+void StyleScanner::printMemoryReport() {
+	if (doMemoryReport) {
+		long inputBytes = getHeapBytes(fileText);
+		long lineBytes = getHeapBytes(fileLines);
+		long typeBytes = getHeapBytes(newTypes)
+			+ getHeapBytes(newTypeLines);
+		long levelBytes = getHeapBytes(commentLines)
+			+ getHeapBytes(scopeLevels) + getHeapBytes(braceLevels)
+			+ getHeapBytes(labelLevels);
+		long errorBytes = errorLines.getHeapBytes();
+		long totalBytes = inputBytes + lineBytes + typeBytes
+			+ levelBytes + errorBytes;
+		cout << "Memory: input " << inputBytes << ", lines " << lineBytes
+			<< ", types " << typeBytes << ", comment/scope " << levelBytes
+			<< ", diagnostics " << errorBytes << " bytes";
+		long textBytes = isStreaming ? streamBytes : getLength(fileText);
+		if (textBytes > 0) {
+			cout << " (" << (double) totalBytes / textBytes
+				<< " per input byte)";
+		}
+		cout << ".\n";
+		batchMemoryBytes += totalBytes;
+		batchInputBytes += textBytes;
+		maxFileMemoryBytes = max(maxFileMemoryBytes, totalBytes);
+	}
+}
+
+// Print memory use summary for the whole batch
+void StyleScanner::printMemorySummary() {
+	if (doMemoryReport) {
+		cout << "\nMemory summary: max file " << maxFileMemoryBytes
+			<< " bytes, total " << batchMemoryBytes << " bytes";
+		if (batchInputBytes > 0) {
+			cout << " (" << (double) batchMemoryBytes / batchInputBytes
+				<< " per input byte)";
+		}
+		long peakRss = getPeakRssKb();
+		if (peakRss >= 0) {
+			cout << ", peak RSS " << peakRss << " KB";
+		}
+		cout << ".\n";
+	}
+}
+
+// Print line verdict memo & function cache use for the batch
+void StyleScanner::printMemoSummary() {
+	long lookups = metrics.getMemoLookups();
+	if (doMemo && lookups > 0) {
+		long hits = metrics.getMemoHits();
+		cout << "\nMemo: " << hits << " of " << lookups
+			<< " lines reused (" << 100 * hits / lookups << "%), "
+			<< verdictMemo.size() << " distinct.\n";
+	}
+	lookups = metrics.getFunctionLookups();
+	if (!cacheFile.empty() && lookups > 0) {
+		long hits = metrics.getFunctionHits();
+		cout << "\nFunction cache: " << hits << " of " << lookups
+			<< " functions reused (" << 100 * hits / lookups << "%), "
+			<< functionCache.size() << " cached.\n";
+	}
+}
+
+// Get heap bytes held by a string
+//   Short strings held inside the object itself count as zero.
+long StyleScanner::getHeapBytes(const string &s) {
+	auto data = s.data();
+	auto object = (const char *) &s;
+	bool isInline = object <= data && data < object + sizeof(string);
+	return isInline ? 0 : (long) s.capacity() + 1;
+}
+
+// Get heap bytes held by a vector of strings
+long StyleScanner::getHeapBytes(const vector<string> &vec) {
+	long bytes = (long) (vec.capacity() * sizeof(string));
+	for (const string &s: vec) {
+		bytes += getHeapBytes(s);
+	}
+	return bytes;
+}
+
+// Get heap bytes held by a vector of ints
+long StyleScanner::getHeapBytes(const vector<int> &vec) {
+	return (long) (vec.capacity() * sizeof(int));
+}
+
+// Get peak resident set size of this process, in kilobytes
+//   Returns -1 where not supported.
+long StyleScanner::getPeakRssKb() {
+	#ifdef __unix__
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+	#else
+	return -1;
+	#endif
+}
+
+// Make an empty line list
+//   A maxLines of zero means no cap.
+LineList::LineList(int maxLines) {
+	maxStored = maxLines;
+}
+
+// Add a line number (in ascending order)
+//   Extends the last run if consecutive; past the cap, only counts.
+void LineList::add(int line) {
+	numTotal++;
+	if (maxStored > 0 && numStored >= maxStored) {
+		return;
+	}
+	numStored++;
+	if (numRuns > 0 && getRun(numRuns - 1).last + 1 == line) {
+		getRun(numRuns - 1).last = line;
+	}
+	else if (numRuns < INLINE_RUNS) {
+		inlineRuns[numRuns++] = {line, line};
+	}
+	else {
+		extraRuns.push_back({line, line});
+		numRuns++;
+	}
+}
+
+// Clear all lines
+//   Spilled run storage keeps its capacity.
+void LineList::clear() {
+	extraRuns.clear();
+	numRuns = 0;
+	numStored = 0;
+	numTotal = 0;
+}
+
+// Get total lines added, including overflow past the cap
+int LineList::size() const {
+	return numTotal;
+}
+
+// Get a stored line by index, in ascending order
+int LineList::operator[](int index) const {
+	assert(0 <= index && index < numStored);
+	for (int i = 0; i < numRuns; i++) {
+		const LineRun &run = getRun(i);
+		int runLength = run.last - run.first + 1;
+		if (index < runLength) {
+			return run.first + index;
+		}
+		index -= runLength;
+	}
+	return -1;
+}
+
+// Get number of stored runs of consecutive lines
+int LineList::getNumRuns() const {
+	return numRuns;
+}
+
+// Get first line of a stored run
+int LineList::getRunFirst(int index) const {
+	return getRun(index).first;
+}
+
+// Get last line of a stored run
+int LineList::getRunLast(int index) const {
+	return getRun(index).last;
+}
+
+// Get heap bytes held (spilled runs only)
+long LineList::getHeapBytes() const {
+	return (long) (extraRuns.capacity() * sizeof(LineRun));
+}
+
+// Get a run by index, inline or spilled
+LineList::LineRun &LineList::getRun(int index) {
+	return index < INLINE_RUNS ? inlineRuns[index]
+		: extraRuns[index - INLINE_RUNS];
+}
+
+// Get a run by index, inline or spilled (const version)
+const LineList::LineRun &LineList::getRun(int index) const {
+	return index < INLINE_RUNS ? inlineRuns[index]
+		: extraRuns[index - INLINE_RUNS];
+}
+
+// Default rule profile: all rules enabled
+RuleProfile::RuleProfile() {
+	for (int i = 0; i < NUM_RULES; i++) {
+		ruleEnabled[i] = true;
+	}
+}
+
+// Flag set by SIGHUP to request a rule profile reload
+volatile sig_atomic_t profileReloadRequested = 0;
+
+// Signal handler for rule profile reloads
+//   Only sets a flag; the swap happens between files.
+void requestProfileReload(int) {
+	profileReloadRequested = 1;
+}
+
+// Load a starter-code baseline
+//   Hashes each run of BASELINE_SPAN lines in the starter file, so
+//   the same runs in a submission can be left out of reports.
+//   Runs with no words (e.g., blanks & braces) are too common to use.
+bool StyleScanner::loadBaseline(const string &name) {
+	ifstream inFile(name);
+	if (!inFile) {
+		cerr << "Error: Baseline not found.\n";
+		return false;
+	}
+	vector<string> lines;
+	string line;
+	while (getline(inFile, line)) {
+		lines.push_back(line);
+		lineHashes.push_back(getLineHash(line));
+	}
+	for (int i = 0; i + BASELINE_SPAN <= getSize(lines); i++) {
+		if (hasWordChars(lines, i)) {
+			starterSpans.insert(getSpanHash(lineHashes, i));
+		}
+	}
+	baselineSpans.insert(starterSpans.begin(), starterSpans.end());
+	return true;
+}
+
+// Load a rule profile file
+//   Profile is parsed fully before replacing the current one,
+//   so a bad file leaves the old profile in effect.
+//   A compiled profile is recognized by its header & read directly.
+bool StyleScanner::loadProfile(const string &name) {
+	ifstream inFile(name, ios::binary);
+	if (!inFile) {
+		cerr << "Error: Profile not found.\n";
+		return false;
+	}
+	char magic[sizeof PROFILE_MAGIC] = {};
+	inFile.read(magic, sizeof magic);
+	if (memcmp(magic, PROFILE_MAGIC, sizeof magic) == 0) {
+		inFile.seekg(0);
+		return loadCompiledProfile(inFile);
+	}
+	inFile.clear();
+	inFile.seekg(0);
+	return loadTextProfile(inFile);
+}
+
+// Load a text profile of "key = value" lines
+//   A text profile has no baseline, so only -b spans are kept.
+bool StyleScanner::loadTextProfile(istream &in) {
+	RuleProfile newProfile;
+	string line;
+	int lineNum = 0;
+	while (getline(in, line)) {
+		lineNum++;
+		if (!parseProfileLine(line, newProfile)) {
+			cerr << "Error: Bad profile setting (line " << lineNum << ").\n";
+			return false;
+		}
+	}
+	baselineSpans = starterSpans;
+	setProfile(newProfile);
+	return true;
+}
+
+// Load a compiled profile: header, profile, then baseline hashes
+//   Read with plain block reads rather than mmap: the file is small,
+//   so copying beats mapping, & this works on every platform.
+bool StyleScanner::loadCompiledProfile(istream &in) {
+	ProfileFileHeader header;
+	RuleProfile newProfile;
+	in.read((char*) &header, sizeof header);
+	if (!in || header.version != PROFILE_VERSION
+		|| header.profileBytes != sizeof(RuleProfile)
+		|| header.hashBytes != sizeof(size_t))
+	{
+		cerr << "Error: Compiled profile is from another version.\n";
+		return false;
+	}
+	in.read((char*) &newProfile, sizeof newProfile);
+	if (in && !isValidProfile(newProfile)) {
+		cerr << "Error: Compiled profile is corrupt.\n";
+		return false;
+	}
+	if (!in || !readBaselineSpans(in, header.numBaselineSpans)) {
+		cerr << "Error: Compiled profile is truncated.\n";
+		return false;
+	}
+	setProfile(newProfile);
+	return true;
+}
+
+// Read a compiled profile's baseline hashes
+//   The count is checked against the file size before allocating.
+//   Spans from the -b starter file are kept; those of any earlier
+//   profile are replaced.
+bool StyleScanner::readBaselineSpans(istream &in, uint64_t count) {
+	if (count > getRemainingBytes(in) / sizeof(size_t)) {
+		return false;
+	}
+	vector<size_t> spans(count);
+	in.read((char*) spans.data(), spans.size() * sizeof(size_t));
+	if (!in) {
+		return false;
+	}
+	baselineSpans = starterSpans;
+	baselineSpans.insert(spans.begin(), spans.end());
+	return true;
+}
+
+// Get the number of bytes left in a seekable stream
+uint64_t StyleScanner::getRemainingBytes(istream &in) {
+	streamoff here = in.tellg();
+	in.seekg(0, ios::end);
+	streamoff end = in.tellg();
+	in.seekg(here);
+	return here >= 0 && end > here ? end - here : 0;
+}
+
+// Does a profile read back from a file hold sane values?
+//   Thresholds are range-checked as in setProfileValue; flags are
+//   checked as raw bytes, since a bool holding another value is
+//   undefined behavior.
+bool StyleScanner::isValidProfile(const RuleProfile &newProfile) {
+	int limits[] = {newProfile.maxLineLength, newProfile.maxFunctionLength,
+		newProfile.maxInlineLength, newProfile.maxUncommentedLines};
+	for (int limit: limits) {
+		if (limit < 0 || limit > MAX_PROFILE_VALUE) {
+			return false;
+		}
+	}
+	for (int i = 0; i < NUM_RULES; i++) {
+		unsigned char flag = 0;
+		memcpy(&flag, &newProfile.ruleEnabled[i], 1);
+		if (flag > 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Replace the current profile
+//   Memoized verdicts may depend on it, so are cleared.
+void StyleScanner::setProfile(const RuleProfile &newProfile) {
+	profile = newProfile;
+	verdictMemo.clear();
+	#ifdef SIGHUP
+	signal(SIGHUP, requestProfileReload);
+	#endif
+}
+
+// Is compile-profile mode set?
+bool StyleScanner::getCompileMode() {
+	return !compiledProfileFile.empty();
+}
+
+// Write current profile & baseline hashes as a compiled profile
+//   Hashes are sorted, so the same inputs give the same file.
+bool StyleScanner::writeCompiledProfile() {
+	ProfileFileHeader header = {};
+	memcpy(header.magic, PROFILE_MAGIC, sizeof header.magic);
+	header.version = PROFILE_VERSION;
+	header.profileBytes = sizeof(RuleProfile);
+	header.hashBytes = sizeof(size_t);
+	header.numBaselineSpans = baselineSpans.size();
+	vector<size_t> spans(baselineSpans.begin(), baselineSpans.end());
+	sort(spans.begin(), spans.end());
+	ofstream outFile(compiledProfileFile, ios::binary);
+	outFile.write((const char*) &header, sizeof header);
+	outFile.write((const char*) &profile, sizeof profile);
+	outFile.write((const char*) spans.data(), spans.size() * sizeof(size_t));
+	if (!outFile) {
+		cerr << "Error: Cannot write compiled profile.\n";
+		return false;
+	}
+	cout << "Compiled profile written to " << compiledProfileFile << ".\n";
+	return true;
+}
+
+// Parse one "key = value" line of a profile
+//   Blank lines & lines starting with '#' are ignored, as is a '#'
+//   comment after the value; any other trailing text is an error.
+bool StyleScanner::parseProfileLine(const string &line,
+	RuleProfile &newProfile)
+{
+	int pos = 0;
+	string key = getNextToken(line, pos);
+	if (key == "" || key[0] == '#') {
+		return true;
+	}
+	string equals = getNextToken(line, pos);
+	string value = getNextToken(line, pos);
+	string rest = getNextToken(line, pos);
+	return equals == "=" && value != "" && (rest == "" || rest[0] == '#')
+		&& setProfileValue(key, value, newProfile);
+}
+
+// Set one profile value by key
+bool StyleScanner::setProfileValue(const string &key, const string &value,
+	RuleProfile &newProfile)
+{
+	int number = getProfileNumber(value);
+	if (key == "maxLineLength") newProfile.maxLineLength = number;
+	else if (key == "maxFunctionLength") newProfile.maxFunctionLength = number;
+	else if (key == "maxInlineLength") newProfile.maxInlineLength = number;
+	else if (key == "maxUncommentedLines")
+		newProfile.maxUncommentedLines = number;
+	else if (key == "enable" || key == "disable") {
+		for (int i = 0; i < NUM_RULES; i++) {
+			if (value == RULE_NAMES[i]) {
+				newProfile.ruleEnabled[i] = key == "enable";
+				return true;
+			}
+		}
+		return false;
+	}
+	else return false;
+	return number >= 0;
+}
+
+// Get a profile threshold from its text
+//   Returns -1 unless all digits & within MAX_PROFILE_VALUE.
+int StyleScanner::getProfileNumber(const string &value) {
+	char *end = nullptr;
+	errno = 0;
+	long number = strtol(value.c_str(), &end, 10);
+	if (!isdigit((unsigned char) value[0]) || *end != '\0'
+		|| errno == ERANGE || number > MAX_PROFILE_VALUE)
+	{
+		return -1;
+	}
+	return (int) number;
+}
+
+// Reload the profile if a reload was signalled
+//   Called between files, so a scan in progress keeps its profile.
+//   Returns true if a new profile was loaded.
+bool StyleScanner::reloadProfileIfRequested() {
+	if (profileReloadRequested) {
+		profileReloadRequested = 0;
+		return loadProfile(profileFile);
+	}
+	return false;
+}
+
+// Record time for a scan stage since the last mark
+void StyleScanner::markStage(int stage) {
+	auto now = chrono::steady_clock::now();
+	chrono::duration<double> elapsed = now - stageStart;
+	metrics.recordStage(stage, elapsed.count());
+	stageStart = now;
+}
+
+// Write metrics file, if requested
+void StyleScanner::writeMetrics() {
+	if (metricsFile != "") {
+		metrics.writeFile(metricsFile);
+	}
+}
+
+// Record a successfully read file
+void ScanMetrics::recordFile(long bytes, long lines) {
+	filesScanned++;
+	bytesScanned += bytes;
+	linesScanned += lines;
+}
+
+// Record a file that could not be scanned
+void ScanMetrics::recordFailure() {
+	filesFailed++;
+}
+
+// Record latency for one scan stage
+void ScanMetrics::recordStage(int stage, double seconds) {
+	assert(0 <= stage && stage < NUM_STAGES);
+	int bucket = 0;
+	while (bucket < NUM_BUCKETS && seconds > BUCKET_BOUNDS[bucket]) {
+		bucket++;
+	}
+	stageCounts[stage][bucket]++;
+	stageSums[stage] += seconds;
+}
+
+// Record heap allocations made while scanning one file
+void ScanMetrics::recordAllocations(long count) {
+	scanAllocations += count;
+	lastScanAllocations = count;
+}
+
+// Record line verdict memo use for one file
+void ScanMetrics::recordMemo(long hits, long lookups) {
+	memoHits += hits;
+	memoLookups += lookups;
+}
+
+// Record function cache use
+void ScanMetrics::recordFunctionCache(long hits, long lookups) {
+	functionHits += hits;
+	functionLookups += lookups;
+}
+
+// Get total line verdict memo hits
+long ScanMetrics::getMemoHits() {
+	return memoHits;
+}
+
+// Get total line verdict memo lookups
+long ScanMetrics::getMemoLookups() {
+	return memoLookups;
+}
+
+// Get total function cache hits
+long ScanMetrics::getFunctionHits() {
+	return functionHits;
+}
+
+// Get total function cache lookups
+long ScanMetrics::getFunctionLookups() {
+	return functionLookups;
+}
+
+// Write all metrics to a file
+//   Written to a temporary first, so a scraper never sees a partial file.
+void ScanMetrics::writeFile(const string &name) {
+	string tempName = getTempName(name);
+	ofstream outFile(tempName);
+	printCounter("stylescanner_files_total",
+		"Files scanned.", filesScanned, outFile);
+	printCounter("stylescanner_files_failed_total",
+		"Files rejected as unreadable.", filesFailed, outFile);
+	printCounter("stylescanner_bytes_total",
+		"Bytes scanned.", bytesScanned, outFile);
+	printCounter("stylescanner_lines_total",
+		"Lines scanned.", linesScanned, outFile);
+	if (COUNTING_ALLOCATIONS) {
+		printCounter("stylescanner_scan_allocations_total",
+			"Heap allocations while scanning.", scanAllocations, outFile);
+		outFile << "# TYPE stylescanner_last_scan_allocations gauge\n";
+		outFile << "stylescanner_last_scan_allocations "
+			<< lastScanAllocations << "\n";
+	}
+	printMemoCounters(outFile);
+	printHistogram(outFile);
+	outFile.close();
+	#ifdef _WIN32
+	remove(name.c_str());
+	#endif
+	rename(tempName.c_str(), name.c_str());
+}
+
+// Print memo & function cache counters, if used
+void ScanMetrics::printMemoCounters(ostream &out) {
+	if (memoLookups > 0) {
+		printCounter("stylescanner_memo_lookups_total",
+			"Lines looked up in the verdict memo.", memoLookups, out);
+		printCounter("stylescanner_memo_hits_total",
+			"Lines with verdicts reused from the memo.", memoHits, out);
+	}
+	if (functionLookups > 0) {
+		printCounter("stylescanner_function_cache_lookups_total",
+			"Functions looked up in the cache.", functionLookups, out);
+		printCounter("stylescanner_function_cache_hits_total",
+			"Functions with verdicts reused from the cache.",
+			functionHits, out);
+	}
+}
+
+// Print one counter metric
+void ScanMetrics::printCounter(const string &name, const string &help,
+	long value, ostream &out)
+{
+	out << "# HELP " << name << " " << help << "\n";
+	out << "# TYPE " << name << " counter\n";
+	out << name << " " << value << "\n";
+}
+
+// Print the stage latency histogram
+void ScanMetrics::printHistogram(ostream &out) {
+	const string NAME = "stylescanner_stage_seconds";
+	out << "# HELP " << NAME << " Scan latency by stage.\n";
+	out << "# TYPE " << NAME << " histogram\n";
+	for (int stage = 0; stage < NUM_STAGES; stage++) {
+		printHistogramStage(out, NAME, stage);
+	}
+}
+
+// Print histogram series for one stage
+//   Buckets are cumulative, ending with +Inf.
+void ScanMetrics::printHistogramStage(ostream &out, const string &name,
+	int stage)
+{
+	string label = "stage=\"" + STAGE_NAMES[stage] + "\"";
+	long total = 0;
+	for (int i = 0; i <= NUM_BUCKETS; i++) {
+		total += stageCounts[stage][i];
+		out << name << "_bucket" << LEFT_BRACE << label << COMMA << "le=\"";
+		if (i < NUM_BUCKETS)
+			out << BUCKET_BOUNDS[i];
+		else
+			out << "+Inf";
+		out << "\"" << RIGHT_BRACE << " " << total << "\n";
+	}
+	out << name << "_sum" << LEFT_BRACE << label << RIGHT_BRACE
+		<< " " << stageSums[stage] << "\n";
+	out << name << "_count" << LEFT_BRACE << label << RIGHT_BRACE
+		<< " " << total << "\n";
+}
+
+// Load a document's text directly, as from an editor
+void StyleScanner::loadText(const string &text) {
+	reset();
+	stageStart = chrono::steady_clock::now();
+	fileText = text;
+	splitFileLines();
+	markStage(STAGE_READ);
+	prescanFile();
+}
+
+// Collect diagnostics for an editor instead of printing reports
+//   Error lines are then kept uncapped.
+void StyleScanner::setCollectMode() {
+	isCollecting = true;
+	errorLines = LineList();
+}
+
+// Take the profile & baseline of another scanner
+//   Lets the LSP server reload once & share it with every document.
+void StyleScanner::adoptProfile(const StyleScanner &source) {
+	setProfile(source.profile);
+	baselineSpans = source.baselineSpans;
+}
+
+// Turn collected error lines into diagnostics, one per run
+void StyleScanner::collectErrors(const char *error) {
+	for (int i = 0; i < errorLines.getNumRuns(); i++) {
+		diagnostics.push_back({errorLines.getRunFirst(i),
+			errorLines.getRunLast(i), error});
+	}
+	errorLines.clear();
+}
+
+// Get number of collected diagnostics
+int StyleScanner::getNumDiagnostics() {
+	return (int) diagnostics.size();
+}
+
+// Get a collected diagnostic by index
+Diagnostic StyleScanner::getDiagnostic(int index) {
+	return diagnostics[index];
+}
+
+// Get number of lines in the file
+int StyleScanner::getNumLines() {
+	return getSize(fileLines);
+}
+
+// Get one line of the file
+string StyleScanner::getLine(int line) {
+	return fileLines[line];
+}
+
+// Is LSP server mode set?
+bool StyleScanner::getLspMode() {
+	return lspMode;
+}
+
+// Is watch mode set?
+bool StyleScanner::getWatchMode() {
+	return watchMode;
+}
+
+// Get a file name by index
+string StyleScanner::getFileName(int index) {
+	return fileNames[index];
+}
+
+// Get index of a file name, adding it if new
+int StyleScanner::getFileIndex(const string &name) {
+	auto found = find(fileNames.begin(), fileNames.end(), name);
+	if (found != fileNames.end()) {
+		return (int) (found - fileNames.begin());
+	}
+	fileNames.push_back(name);
+	return getSize(fileNames) - 1;
+}
+
+// Is this name a directory?
+bool StyleScanner::isDirectory(const string &name) {
+	#ifdef __unix__
+	DIR *dir = opendir(name.c_str());
+	if (dir != nullptr) {
+		closedir(dir);
+	}
+	return dir != nullptr;
+	#else
+	return false;
+	#endif
+}
+
+// Flag set by SIGINT or SIGTERM to stop watching
+volatile sig_atomic_t watchStopRequested = 0;
+
+// Signal handler for stopping watch mode
+//   Only sets a flag; the watcher finishes up once its wait ends.
+void requestWatchStop(int) {
+	watchStopRequested = 1;
+}
+
+// Make a watcher over the scanner's files & directories
+FileWatcher::FileWatcher(StyleScanner &checker): scanner(checker) {
+}
+
+// Scan all files, then rescan each as it changes
+//   The first scan finishes as a batch (summaries & saved cache);
+//   the cache is saved again on SIGINT or SIGTERM, with rescans.
+//   Files gone by the time a burst settles are skipped.
+//   Returns false if watching is unavailable.
+bool FileWatcher::run() {
+	if (!watchFiles()) {
+		return false;
+	}
+	scanner.finishBatch();
+	signal(SIGINT, requestWatchStop);
+	signal(SIGTERM, requestWatchStop);
+	cout << "\nWatching for changes...\n" << flush;
+	set<string> changed;
+	while (waitForChanges(changed)) {
+		for (const string &name: changed) {
+			if (ifstream(name)) {
+				scanner.scanFile(scanner.getFileIndex(name));
+			}
+		}
+		cout << flush;
+	}
+	scanner.writeFunctionCache();
+	return true;
+}
+
+// Scan each file & add watches
+//   Directories are not scanned at first; their source files are
+//   scanned when written.
+bool FileWatcher::watchFiles() {
+	#ifdef __linux__
+	notifyFd = inotify_init1(IN_CLOEXEC);
+	#endif
+	int numFiles = scanner.getNumFiles();
+	for (int i = 0; i < numFiles; i++) {
+		string name = scanner.getFileName(i);
+		bool isDirectory = scanner.isDirectory(name);
+		if (!isDirectory) {
+			scanner.scanFile(i);
+		}
+		if (!addWatch(name, isDirectory)) {
+			cerr << "Error: Cannot watch " << name << ".\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Add a watch for a directory, or for a file via its directory
+bool FileWatcher::addWatch(const string &path, bool isDirectory) {
+	string dir = path;
+	string name;
+	if (!isDirectory) {
+		size_t slash = path.rfind('/');
+		dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+		name = slash == string::npos ? path : path.substr(slash + 1);
+	}
+	int watch = -1;
+	#ifdef __linux__
+	watch = inotify_add_watch(notifyFd, dir.c_str(),
+		IN_CLOSE_WRITE | IN_MOVED_TO);
+	#endif
+	if (watch < 0) {
+		return false;
+	}
+	bool hasSlash = !dir.empty() && dir.back() == '/';
+	watchDirs[watch] = dir == "." ? "" : (hasSlash ? dir : dir + "/");
+	if (isDirectory) {
+		watchAll.insert(watch);
+	}
+	watchNames[watch].insert(name);
+	return true;
+}
+
+// Wait for changes, then settle
+//   Waits for a first event, then keeps reading until no event
+//   comes for a short while, so a burst of writes (e.g., editor
+//   save, or copying a whole lab in) rescans each file once.
+//   Returns false on a poll error, or once asked to stop.
+bool FileWatcher::waitForChanges(set<string> &changed) {
+	changed.clear();
+	#ifdef __linux__
+	pollfd watchPoll = {notifyFd, POLLIN, 0};
+	int timeout = -1;
+	while (true) {
+		int ready = poll(&watchPoll, 1, timeout);
+		if ((ready < 0 && errno != EINTR) || watchStopRequested) {
+			return false;
+		}
+		if (ready > 0) {
+			readEvents(changed);
+		}
+		else if (!changed.empty()) {
+			return true;
+		}
+		timeout = changed.empty() ? -1 : SETTLE_MS;
+	}
+	#else
+	return false;
+	#endif
+}
+
+// Read pending events & add changed file names
+void FileWatcher::readEvents(set<string> &changed) {
+	#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length = read(notifyFd, buffer, sizeof buffer);
+	for (ssize_t pos = 0; pos < length; ) {
+		auto event = (const inotify_event*) (buffer + pos);
+		pos += sizeof(inotify_event) + event->len;
+		string name = event->len > 0 ? event->name : "";
+		if (isWatchedName(event->wd, name)) {
+			changed.insert(watchDirs[event->wd] + name);
+		}
+	}
+	#endif
+}
+
+// Is this name in a watched directory one to rescan?
+bool FileWatcher::isWatchedName(int watch, const string &name) {
+	if (name.empty() || watchDirs.count(watch) == 0) {
+		return false;
+	}
+	if (watchNames[watch].count(name) > 0) {
+		return true;
+	}
+	return watchAll.count(watch) > 0 && scanner.isSourceName(name);
+}
+
+// Parse a complete JSON text
+bool JsonValue::parse(const string &text) {
+	size_t pos = 0;
+	if (!parseValue(text, pos)) {
+		return false;
+	}
+	skipSpace(text, pos);
+	return pos == text.size();
+}
+
+// Get an object member by key
+//   Returns a null value if not present.
+const JsonValue &JsonValue::get(const string &key) const {
+	static const JsonValue NONE;
+	for (int i = 0; i < (int) keys.size(); i++) {
+		if (keys[i] == key) {
+			return items[i];
+		}
+	}
+	return NONE;
+}
+
+// Get an array item by index
+const JsonValue &JsonValue::at(int index) const {
+	assert(0 <= index && index < size());
+	return items[index];
+}
+
+// Get number of array items (or object members)
+int JsonValue::size() const {
+	return (int) items.size();
+}
+
+// Is there an object member with this key?
+bool JsonValue::has(const string &key) const {
+	return find(keys.begin(), keys.end(), key) != keys.end();
+}
+
+// Get string contents (or literal text)
+string JsonValue::asString() const {
+	return value;
+}
+
+// Get integer value
+int JsonValue::asInt() const {
+	return type == JSON_NUMBER ? atoi(value.c_str()) : 0;
+}
+
+// Write a scalar value back as JSON (e.g., a request id)
+string JsonValue::toJson() const {
+	switch (type) {
+		case JSON_STRING: return jsonQuote(value);
+		case JSON_BOOL: case JSON_NUMBER: return value;
+		default: return "null";
 	}
-	return lastToken;
 }
 
-// Show all tokens in file (for testing)
-void StyleScanner::showTokens() {
-	for (string line: fileLines) {
-		int pos = 0;
-		string token = getNextToken(line, pos);
-		while (token != "") {
-			cout << token << endl;
-			token = getNextToken(line, pos);
-		}
-		cout << endl;
+// Parse any value at pos
+bool JsonValue::parseValue(const string &text, size_t &pos) {
+	skipSpace(text, pos);
+	if (pos >= text.size()) {
+		return false;
+	}
+	switch (text[pos]) {
+		case LEFT_BRACE: return parseObject(text, pos);
+		case '[': return parseArray(text, pos);
+		case '"': type = JSON_STRING; return parseString(text, pos, value);
+		default: return parseLiteral(text, pos);
 	}
-	cout << endl;
 }
 
-// Is this string a fundamental type?
-bool StyleScanner::isBasicType(const string &s) {
-	const string TYPES[] = {"int", "float", "double",
-		"char", "bool", "string", "void"};
-	for (string type: TYPES) {
-		if (s == type) {
+// Parse an object at pos
+bool JsonValue::parseObject(const string &text, size_t &pos) {
+	type = JSON_OBJECT;
+	pos++;
+	skipSpace(text, pos);
+	if (pos < text.size() && text[pos] == RIGHT_BRACE) {
+		pos++;
+		return true;
+	}
+	while (pos < text.size()) {
+		string key;
+		skipSpace(text, pos);
+		if (!parseString(text, pos, key)) return false;
+		skipSpace(text, pos);
+		if (pos >= text.size() || text[pos++] != ':') return false;
+		items.emplace_back();
+		keys.push_back(key);
+		if (!items.back().parseValue(text, pos)) return false;
+		skipSpace(text, pos);
+		if (pos < text.size() && text[pos] == RIGHT_BRACE) {
+			pos++;
 			return true;
 		}
+		if (pos >= text.size() || text[pos++] != COMMA) return false;
 	}
 	return false;
 }
 
-// Is this string a new defined type in this file?
-bool StyleScanner::isNewType(const string &s) {
-	for (string t: newTypes) {
-		if (s == t)
+// Parse an array at pos
+bool JsonValue::parseArray(const string &text, size_t &pos) {
+	type = JSON_ARRAY;
+	pos++;
+	skipSpace(text, pos);
+	if (pos < text.size() && text[pos] == ']') {
+		pos++;
+		return true;
+	}
+	while (pos < text.size()) {
+		items.emplace_back();
+		if (!items.back().parseValue(text, pos)) return false;
+		skipSpace(text, pos);
+		if (pos < text.size() && text[pos] == ']') {
+			pos++;
 			return true;
+		}
+		if (pos >= text.size() || text[pos++] != COMMA) return false;
 	}
 	return false;
 }
 
-// Is this string any known type?
-bool StyleScanner::isAnyType(const string &s) {
-	return isBasicType(s) || isNewType(s);
+// Parse a number, true, false, or null at pos
+bool JsonValue::parseLiteral(const string &text, size_t &pos) {
+	size_t start = pos;
+	while (pos < text.size() && (isalnum(text[pos])
+		|| text[pos] == '-' || text[pos] == '+' || text[pos] == '.'))
+	{
+		pos++;
+	}
+	value = text.substr(start, pos - start);
+	if (value == "true" || value == "false") {
+		type = JSON_BOOL;
+	}
+	else if (value == "null") {
+		type = JSON_NULL;
+	}
+	else {
+		type = JSON_NUMBER;
+	}
+	return pos > start;
 }
 
-// Is this string an acceptable constant name?
-bool StyleScanner::isOkConstant(const string &s) {
-	if (getLength(s) < 2) {
+// Parse a string at pos, decoding escapes
+bool JsonValue::parseString(const string &text, size_t &pos, string &out) {
+	if (pos >= text.size() || text[pos] != '"') {
 		return false;
 	}
-	for (char c: s) {
-		if (!isupper(c) && c != '_') {
-			return false;
+	for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+		if (text[pos] != '\\') {
+			out += text[pos];
 		}
-	}
-	return true;
-}
-
-// Check constant names
-void StyleScanner::checkConstantNames() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			int pos = 0;
-			string line = fileLines[i];
-			string prefix = getNextToken(line, pos);
-			if (prefix == "const") {
-				string type = getNextToken(line, pos);
-				if (isBasicType(type)) {
-					string name = getNextToken(line, pos);
-					if (!isOkConstant(name)) {
-						errorLines.push_back(i);
-					}
-				}
+		else if (++pos < text.size()) {
+			switch (text[pos]) {
+				case 'n': out += '\n'; break;
+				case 't': out += '\t'; break;
+				case 'r': out += '\r'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'u': if (!parseEscape(text, pos, out)) return false; break;
+				default: out += text[pos];
 			}
 		}
 	}
-	printErrors("Constants should be all-caps name", errorLines);
+	return pos++ < text.size();
 }
 
-// Is this string an acceptable variable name?
-bool StyleScanner::isOkVariable(const string &s) {
-	if (getLength(s) < 2
-		|| !islower(s[0]))
+// Parse a Unicode escape (at its 'u') into UTF-8
+//   A surrogate pair escaped as two units is joined into one code
+//   point. Returns false unless four hex digits follow.
+bool JsonValue::parseEscape(const string &text, size_t &pos, string &out) {
+	uint32_t code = 0;
+	uint32_t low = 0;
+	if (!parseHex(text, pos + 1, code)) {
+		return false;
+	}
+	pos += 4;
+	if (code >= 0xD800 && code < 0xDC00 && text.compare(pos + 1, 2, "\\u") == 0
+		&& parseHex(text, pos + 3, low) && low >= 0xDC00 && low < 0xE000)
 	{
+		code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+		pos += 6;
+	}
+	appendUtf8(out, code);
+	return true;
+}
+
+// Parse four hex digits at pos
+bool JsonValue::parseHex(const string &text, size_t pos, uint32_t &code) {
+	if (pos + 4 > text.size()) {
 		return false;
 	}
-	for (int i = 1; i < getLength(s); i++) {
-		if (!isalnum(s[i])
-			|| (isupper(s[i]) && isupper(s[i - 1])))
-		{
+	code = 0;
+	for (size_t i = pos; i < pos + 4; i++) {
+		unsigned char c = text[i];
+		if (!isxdigit(c)) {
 			return false;
 		}
+		code = code * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
 	}
 	return true;
 }
 
-// Does this token start with an open parenthesis?
-bool StyleScanner::isStartParen(const string &s) {
-	return getLength(s) > 0 && s[0] == '(';
+// Skip whitespace at pos
+void JsonValue::skipSpace(const string &text, size_t &pos) {
+	while (pos < text.size() && isspace(text[pos])) {
+		pos++;
+	}
 }
 
-// Does this symbol after an identifier indicate a function?
-bool StyleScanner::isFunctionSymbol(const string& symbol) {
-	return isStartParen(symbol)
-		|| symbol == "::"
-		|| symbol == "<";
+// Quote a string for JSON output
+string jsonQuote(const string &s) {
+	string out = "\"";
+	for (char c: s) {
+		switch (c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default: out += c;
+		}
+	}
+	return out + "\"";
 }
 
-// Check variable names
-//   Note we check only first variable declared on a line.
-void StyleScanner::checkVariableNames() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			int pos = 0;
-			string line = fileLines[i];
-			string type = getNextToken(line, pos);
-			if (isBasicType(type)) {
-
-				// Get the variable name
-				string name = getNextToken(line, pos);
-				while (name == "*") {
-					name = getNextToken(line, pos);
-				}
+// Wrap JSON members in object braces
+string jsonObject(const string &members) {
+	return LEFT_BRACE + members + RIGHT_BRACE;
+}
 
-				// Check only non-function names
-				string nextSymbol = getNextToken(line, pos);
-				if (!isFunctionSymbol(nextSymbol)) {
-					if (!isOkVariable(name)) {
-						errorLines.push_back(i);
-					}
-				}
-			}
+// Make a server using the given scanner settings
+LspServer::LspServer(const StyleScanner &settings): prototype(settings) {
+	prototype.setCollectMode();
+}
+
+// Run the server until exit
+//   Diagnostics are published only once no more input is waiting,
+//   so a burst of keystrokes is checked once, not per keystroke.
+//   Pending diagnostics also go out before any request is answered.
+void LspServer::run() {
+	string body;
+	while (readMessage(body)) {
+		JsonValue message;
+		if (!message.parse(body)) {
+			sendError(JsonValue(), -32700, "Parse error");
+			continue;
+		}
+		if (message.has("id")) {
+			publishPending();
+		}
+		if (!handleMessage(message)) {
+			break;
+		}
+		if (cin.rdbuf()->in_avail() <= 0) {
+			publishPending();
 		}
 	}
-	printErrors("Variables need full camelCase name", errorLines);
 }
 
-// Is this string an acceptable function name?
-//   Currently same rule as for variable names.
-bool StyleScanner::isOkFunction(const string &s) {
-	return isOkVariable(s);
+// Read one message (headers, then body) from standard input
+//   A header block without a usable length is answered with an error
+//   and skipped; returns false at end of input.
+bool LspServer::readMessage(string &body) {
+	const long MAX_MESSAGE_SIZE = 1L << 26;
+	long length = -1;
+	while (readHeaders(length)) {
+		if (length >= 0 && length <= MAX_MESSAGE_SIZE) {
+			body.resize(length);
+			cin.read(&body[0], length);
+			return (bool) cin;
+		}
+		sendError(JsonValue(), -32600, "Invalid message header");
+		if (length > 0) {
+			cin.ignore(length);
+		}
+	}
+	return false;
 }
 
-// Check function names
-void StyleScanner::checkFunctionNames() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			string name;
-			if (isFunctionHeader(fileLines[i], name)) {
-				if (!isOkFunction(name)) {
-					errorLines.push_back(i);
-				}
+// Read one header block, up to its blank line
+//   The length is -1 unless a valid Content-Length was given.
+bool LspServer::readHeaders(long &length) {
+	string header;
+	length = -1;
+	while (getline(cin, header)) {
+		if (!header.empty() && header.back() == '\r') {
+			header.pop_back();
+		}
+		if (header.empty()) {
+			break;
+		}
+		if (header.compare(0, 15, "Content-Length:") == 0) {
+			char *start = &header[15];
+			char *end = nullptr;
+			errno = 0;
+			length = strtol(start, &end, 10);
+			if (end == start || *end != '\0' || errno == ERANGE) {
+				length = -1;
 			}
 		}
 	}
-	printErrors("Functions need full camelCase name", errorLines);
+	return (bool) cin;
 }
 
-// Is there a lead-in comment to the function here?
-bool StyleScanner::isLeadInCommentHere(int line) {
+// Handle one message
+//   Returns false on exit notification.
+bool LspServer::handleMessage(const JsonValue &message) {
+	string method = message.get("method").asString();
+	const JsonValue &params = message.get("params");
+	const JsonValue &id = message.get("id");
+	if (method == "initialize") {
+		setPositionEncoding(params);
+		sendResult(id, jsonObject("\"capabilities\": " + jsonObject(
+			"\"positionEncoding\": "
+			+ string(isUtf8Positions ? "\"utf-8\"" : "\"utf-16\"")
+			+ ", \"textDocumentSync\": "
+			+ jsonObject("\"openClose\": true, \"change\": 2"))));
+	}
+	else if (method == "textDocument/didOpen") openDocument(params);
+	else if (method == "textDocument/didChange") changeDocument(params);
+	else if (method == "textDocument/didClose") closeDocument(params);
+	else if (method == "shutdown") sendResult(id, "null");
+	else if (method == "exit") return false;
+	else if (message.has("id")) {
+		sendError(id, -32601, "Method not found");
+	}
+	return true;
+}
 
-	// No room for comment
-	if (line < 1)
-		return false;
-		
-	// Handle template prefix
-	if (getFirstToken(fileLines[line - 1]) == "template")
-		return isLeadInCommentHere(line - 1);
-	
-	// Handle comment one line above
-	if (isCommentLine(line - 1))
-		return true;
-		
-	// Handle comment two lines above
-	if (line > 1
-			&& isBlank(line - 1)
-			&& isCommentLine(line - 2))
-		return true;
-	
-	// Failure
-	return false;
+// Open a document: full scan of its text
+void LspServer::openDocument(const JsonValue &params) {
+	const JsonValue &document = params.get("textDocument");
+	string uri = document.get("uri").asString();
+	StyleScanner &doc = documents.insert({uri, prototype}).first->second;
+	doc.loadText(document.get("text").asString());
+	pendingUris.insert(uri);
 }
 
-// Check for lead-in comments before functions
-void StyleScanner::checkFunctionLeadComments() {
-	if (doFunctionCommentCheck) {
-		vector<int> errorLines;
-		for (int i = 0; i < getSize(fileLines); i++) {
-			if (!isCommentLine(i)
-				&& scopeLevels[i] == 0
-				&& isFunctionHeader(fileLines[i])
-				&& !isLeadInCommentHere(i)) 
-			{
-				errorLines.push_back(i);
-			}
+// Change a document: apply each change in order
+void LspServer::changeDocument(const JsonValue &params) {
+	string uri = params.get("textDocument").get("uri").asString();
+	auto entry = documents.find(uri);
+	if (entry != documents.end()) {
+		const JsonValue &changes = params.get("contentChanges");
+		for (int i = 0; i < changes.size(); i++) {
+			applyChange(entry->second, changes.at(i));
 		}
-		printErrors("Functions should have a lead-in comment", errorLines);
+		pendingUris.insert(uri);
 	}
 }
 
-// Is the given line a function header?
-bool StyleScanner::isFunctionHeader(const string &s) {
-	string dummyName;
-	return isFunctionHeader(s, dummyName);
+// Apply one content change to a document
+//   A ranged change becomes a line-range edit, so only the edited
+//   region is rescanned; a change without range replaces all text.
+//   Character offsets are converted to bytes in the UTF-8 lines.
+//   Positions are clamped to the document, & a reversed range is
+//   taken end first.
+void LspServer::applyChange(StyleScanner &doc, const JsonValue &change) {
+	string text = change.get("text").asString();
+	if (!change.has("range") || doc.getNumLines() == 0) {
+		doc.loadText(text);
+		return;
+	}
+	const JsonValue &start = change.get("range").get("start");
+	const JsonValue &end = change.get("range").get("end");
+	int lastLine = doc.getNumLines() - 1;
+	int startLine = max(0, min(start.get("line").asInt(), lastLine));
+	int endLine = max(0, min(end.get("line").asInt(), lastLine));
+	string first = doc.getLine(startLine);
+	string last = doc.getLine(endLine);
+	int startChar = getByteOffset(first, start.get("character").asInt());
+	int endChar = getByteOffset(last, end.get("character").asInt());
+	if (startLine > endLine || (startLine == endLine && startChar > endChar)) {
+		swap(startLine, endLine);
+		swap(first, last);
+		swap(startChar, endChar);
+	}
+	string joined = first.substr(0, startChar) + text + last.substr(endChar);
+	doc.applyEdit(startLine, endLine - startLine + 1, splitText(joined));
 }
 
-// Is the given line a function header?
-//   If so, return function name in parameter.
-bool StyleScanner::isFunctionHeader(const string &s, string &name) {
-	int pos = 0;
-	string type = getNextToken(s, pos);
-	if (isBasicType(type) && !isLineEndingSemicolon(s))
-	{
-		name = getNextToken(s, pos);
-		while (name == "*") {
-			name = getNextToken(s, pos);
-		}
-		string nextSymbol = getNextToken(s, pos);
-		if (nextSymbol == "::") {
-			name = getNextToken(s, pos);
-			nextSymbol = getNextToken(s, pos);
-		}
-		if (isStartParen(nextSymbol)) {
-			return true;
+// Split edited text into lines
+vector<string> LspServer::splitText(const string &text) {
+	vector<string> lines;
+	size_t lineStart = 0;
+	size_t lineEnd = text.find('\n');
+	for (; lineEnd != string::npos; lineEnd = text.find('\n', lineStart)) {
+		size_t crLength = lineEnd > lineStart && text[lineEnd - 1] == '\r';
+		lines.push_back(text.substr(lineStart, lineEnd - lineStart - crLength));
+		lineStart = lineEnd + 1;
+	}
+	lines.push_back(text.substr(lineStart));
+	return lines;
+}
+
+// Choose the position encoding from the client's capabilities
+//   UTF-8 if offered (offsets are then bytes), else the default UTF-16.
+void LspServer::setPositionEncoding(const JsonValue &params) {
+	const JsonValue &encodings = params.get("capabilities").get("general")
+		.get("positionEncodings");
+	isUtf8Positions = false;
+	for (int i = 0; i < encodings.size(); i++) {
+		if (encodings.at(i).asString() == "utf-8") {
+			isUtf8Positions = true;
 		}
 	}
-	return false;
 }
 
-// Is this string an acceptable new type name?
-bool StyleScanner::isOkTypeName(const string &s) {
-	if (getLength(s) < 2
-		|| !isupper(s[0]))
-	{
-		return false;
+// Get the byte offset in a line of an LSP character position
+//   A UTF-16 position counts 2 units for characters beyond 16 bits.
+int LspServer::getByteOffset(const string &line, int character) {
+	character = max(0, character);
+	if (isUtf8Positions) {
+		return min(character, (int) line.size());
 	}
-	for (int i = 1; i < getLength(s); i++) {
-		if (!isalnum(s[i])
-			|| (isupper(s[i]) && isupper(s[i - 1])))
-		{
-			return false;
-		}
+	int units = 0;
+	size_t pos = 0;
+	while (pos < line.size() && units < character) {
+		unsigned char c = line[pos];
+		size_t length = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+		units += length == 4 ? 2 : 1;
+		pos = min(line.size(), pos + length);
 	}
-	return true;
+	return (int) pos;
 }
 
-// Check class names
-void StyleScanner::checkClassNames() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		if (!isCommentLine(i)) {
-			int pos = 0;
-			string line = fileLines[i];
-			string prefix = getNextToken(line, pos);
-			if (isClassKeyword(prefix)) {
-				string name = getNextToken(line, pos);
-				if (!isOkTypeName(name)) {
-					errorLines.push_back(i);
-				}
-			}
+// Get the length of a line in LSP characters
+int LspServer::getCharLength(const string &line) {
+	if (isUtf8Positions) {
+		return (int) line.size();
+	}
+	int units = 0;
+	for (unsigned char c: line) {
+		if ((c & 0xC0) != 0x80) {
+			units += c >= 0xF0 ? 2 : 1;
 		}
 	}
-	printErrors("Class/structs should start caps camel-case", errorLines);
+	return units;
 }
 
-// Is this a class/struct header line?
-bool StyleScanner::isClassHeader(const string &s) {
-	return isClassKeyword(getFirstToken(s));
+// Close a document & clear its diagnostics
+void LspServer::closeDocument(const JsonValue &params) {
+	string uri = params.get("textDocument").get("uri").asString();
+	documents.erase(uri);
+	pendingUris.erase(uri);
+	sendMessage("\"method\": \"textDocument/publishDiagnostics\", "
+		"\"params\": " + jsonObject("\"uri\": " + jsonQuote(uri)
+		+ ", \"diagnostics\": []"));
 }
 
-// Is this the keyword for a class/struct?
-bool StyleScanner::isClassKeyword(const string &s) {
-	return s == "class" || s == "struct";
+// Check & publish all documents changed since last publish
+void LspServer::publishPending() {
+	reloadProfile();
+	for (const string &uri: pendingUris) {
+		publishDiagnostics(uri, documents.at(uri));
+	}
+	pendingUris.clear();
 }
 
-// Is this a preprocessor directive?
-bool StyleScanner::isPreprocessorDirective(const string &s) {
-	return getFirstToken(s) == "#";
+// Reload the profile once for all documents, if signalled
+//   Each open document is then rechecked with the new profile.
+void LspServer::reloadProfile() {
+	if (!prototype.reloadProfileIfRequested()) {
+		return;
+	}
+	for (auto &entry: documents) {
+		entry.second.adoptProfile(prototype);
+		pendingUris.insert(entry.first);
+	}
 }
 
-// Check extraneous blank lines
-//    Blank lines should only occur:
-//    before comment, label, function, class, or preprocessor directive
-void StyleScanner::checkExtraneousBlanks() {
-	vector<int> errorLines;
-	for (int i = 0; i < (int) getSize(fileLines) - 2; i++) {
-		if (isBlank(i)) {
-			int next = i + 1;
-			string nextLine = fileLines[next];
-			if (!commentLines[next]
-				&& !isLineLabel(nextLine)
-				&& !isFunctionHeader(nextLine)
-				&& !isClassHeader(nextLine)
-				&& !isPreprocessorDirective(nextLine))
-			{
-				errorLines.push_back(i);
-			}
-		}
+// Check one document & publish its diagnostics
+void LspServer::publishDiagnostics(const string &uri, StyleScanner &doc) {
+	doc.checkErrors();
+	string list;
+	for (int i = 0; i < doc.getNumDiagnostics(); i++) {
+		list += (i > 0 ? ", " : "") + getDiagnosticJson(doc, i);
 	}
-	printErrors("Extraneous blank lines", errorLines);
+	sendMessage("\"method\": \"textDocument/publishDiagnostics\", "
+		"\"params\": " + jsonObject("\"uri\": " + jsonQuote(uri)
+		+ ", \"diagnostics\": [" + list + "]"));
 }
 
-// C++-style comments should have a space after slashes.
-void StyleScanner::checkStartSpaceComments() {
-	vector<int> errorLines;
-	for (int i = 0; i < getSize(fileLines); i++) {
-		int pos = 0;
-		string line = fileLines[i];
-		string token = getNextToken(line, pos);
-		if (token == DOUBLE_SLASH
-			&& pos < getLength(line)
-			&& !isspace(line[pos]))
-		{
-			errorLines.push_back(i);
-		}
-	}
-	printErrors("Comments need space after slashes", errorLines);
+// Get one diagnostic as JSON, ranging over whole lines
+string LspServer::getDiagnosticJson(StyleScanner &doc, int index) {
+	Diagnostic diag = doc.getDiagnostic(index);
+	int lastLine = min(diag.lastLine, doc.getNumLines() - 1);
+	int endChar = getCharLength(doc.getLine(lastLine));
+	string start = jsonObject("\"line\": " + to_string(diag.firstLine)
+		+ ", \"character\": 0");
+	string end = jsonObject("\"line\": " + to_string(lastLine)
+		+ ", \"character\": " + to_string(endChar));
+	return jsonObject("\"range\": " + jsonObject("\"start\": " + start
+		+ ", \"end\": " + end) + ", \"severity\": 2, "
+		+ "\"source\": \"StyleScanner\", \"message\": "
+		+ jsonQuote(diag.message));
 }
 
-// Check for overly long functions.
-void StyleScanner::checkFunctionLength() {
-	if (doFunctionLengthCheck) {
-		vector<int> errorLines;
-		bool inClassHeader = false;
-		for (int i = 0; i < getSize(fileLines); i++) {
-			if (scopeLevels[i] == 0) {
-				inClassHeader = false;
-			}
-			if (!commentLines[i]) {
-				if (isClassHeader(fileLines[i])) {
-					inClassHeader = true;
-				}
-				if (isFunctionHeader(fileLines[i])) {
-					if (countFunctionLength(i) >
-						getFunctionLengthLimit(inClassHeader)) 
-					{
-						errorLines.push_back(i);
-					}
-				}
-			}
-		}
-		printErrors("Function is too long!", errorLines);
-	}
+// Send a response to a request
+void LspServer::sendResult(const JsonValue &id, const string &result) {
+	sendMessage("\"id\": " + id.toJson() + ", \"result\": " + result);
 }
 
-// Get the relevant function length limit
-int StyleScanner::getFunctionLengthLimit(bool inClassHeader) {
-	const int MAX_INLINE = 1;
-	const int LONG_FUNC = 25;
-	return inClassHeader ? MAX_INLINE : LONG_FUNC;
+// Send an error response to a request
+void LspServer::sendError(const JsonValue &id, int code, const string &text) {
+	sendMessage("\"id\": " + id.toJson() + ", \"error\": "
+		+ jsonObject("\"code\": " + to_string(code)
+		+ ", \"message\": " + jsonQuote(text)));
 }
 
-// Count function length from header line
-int StyleScanner::countFunctionLength(int startLine) {
-	int startScope = scopeLevels[startLine];
-	int line = startLine + 1;
-	while (line < getSize(fileLines) &&
-		(isLineStartOpenBrace(fileLines[line])
-			|| scopeLevels[line] > startScope))
-	{
-		line++;
-	}
-	return line - startLine - 1;
+// Send one message with its header
+void LspServer::sendMessage(const string &body) {
+	string json = jsonObject("\"jsonrpc\": \"2.0\", " + body);
+	cout << "Content-Length: " << json.size() << "\r\n\r\n" << json;
+	cout.flush();
 }
 
-// Main test driver
-int main(int argc, char** argv) {
+// Run the scanner for the command line
+int runScanner(int argc, char** argv) {
 	StyleScanner checker;
-	checker.printBanner();
 	checker.parseArgs(argc, argv);
+	if (checker.getLspMode() && !checker.getExitAfterArgs()) {
+		LspServer server(checker);
+		server.run();
+		return 0;
+	}
+	checker.printBanner();
 	if (checker.getExitAfterArgs()) {
 		checker.printUsage();
 	}
+	else if (checker.getCompileMode()) {
+		return checker.writeCompiledProfile() ? 0 : 1;
+	}
+	else if (checker.getWatchMode()) {
+		FileWatcher watcher(checker);
+		return watcher.run() ? 0 : 1;
+	}
 	else {
-		if (checker.readFile()) {
-			checker.checkErrors();
-		}
+		return checker.scanBatch() ? 0 : 1;
 	}
 	return 0;
 }
+
+// Main test driver
+//   Output goes through one large buffer, flushed after each file's
+//   report (or when full), rather than per line. Standard error is
+//   tied to standard output, so messages stay in order.
+int main(int argc, char** argv) {
+	ios::sync_with_stdio(false);
+	OutputBuf outputBuf(stdout);
+	streambuf *consoleBuf = cout.rdbuf(&outputBuf);
+	int status = runScanner(argc, argv);
+	cout.flush();
+	cout.rdbuf(consoleBuf);
+	return status;
+}
@@ -0,0 +1,48 @@
+/*
+	Name: alloc_test
+	Copyright: 2026
+	Author: StyleScanner contributors
+	Date: 10/17/26
+	Description: 
+		Checks that a warm scan makes no heap allocations. Scans
+		a corpus of files twice in one batch, counting allocations
+		with the scanner's COUNT_ALLOCATIONS build; the second pass
+		must allocate nothing.
+		Build & run from the repository root:
+			g++ -std=c++11 -O2 -o alloc_test tests/alloc_test.cpp
+			./alloc_test tests/edit_test.cpp StyleScanner.cpp
+		Exits nonzero if the second pass allocates.
+*/
+
+// Count allocations, & rename the scanner's main(), to include it whole
+#define COUNT_ALLOCATIONS
+#define main styleScannerMain
+#include "../StyleScanner.cpp"
+#undef main
+
+// Scan every file in the list, returning the allocations made
+//   Reports are discarded (without allocating) while scanning.
+long scanAll(StyleScanner &scanner) {
+	long startCount = allocationCount;
+	cout.setstate(ios::badbit);
+	for (int i = 0; i < scanner.getNumFiles(); i++) {
+		scanner.scanFile(i);
+	}
+	cout.clear();
+	return allocationCount - startCount;
+}
+
+// Scan the corpus twice & check the second pass
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		cerr << "Usage: alloc_test file...\n";
+		return 2;
+	}
+	StyleScanner scanner;
+	scanner.parseArgs(argc, argv);
+	long coldCount = scanAll(scanner);
+	long warmCount = scanAll(scanner);
+	cout << "Allocations: first pass " << coldCount
+		<< ", second pass " << warmCount << "\n";
+	return warmCount == 0 ? 0 : 1;
+}
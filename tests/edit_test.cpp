@@ -0,0 +1,107 @@
+/*
+	Name: edit_test
+	Copyright: 2026
+	Author: StyleScanner contributors
+	Date: 10/17/26
+	Description: 
+		Checks that incremental prescans after editor (LSP) edits
+		match a full prescan of the edited file. Random files of
+		comment, brace, label, & class lines get random edits; after
+		each, every per-line level & the new type list must agree.
+		Build & run from the repository root:
+			g++ -std=c++11 -O2 -o edit_test tests/edit_test.cpp
+			./edit_test
+		Exits nonzero if any trial fails.
+*/
+
+#include <random>
+
+// Rename the scanner's main(), to include it whole
+#define main styleScannerMain
+#include "../StyleScanner.cpp"
+#undef main
+
+// Lines to build random files from
+const char *const LINE_POOL[] = {"int x = 1;", "{", "}", "/* start",
+	"end */", "/* one */", "// c", "void f() {", "\tcase 1:", "public:",
+	"class Foo {", "struct Bar {", "};", "", "  x++;", "} else {",
+	"default:", "\t\ty--; // note"};
+const int POOL_SIZE = sizeof LINE_POOL / sizeof LINE_POOL[0];
+const int NUM_TRIALS = 20000;
+const int EDITS_PER_TRIAL = 5;
+
+// ScannerTest class
+//   A friend of StyleScanner, to reach its prescan internals.
+class ScannerTest {
+	public:
+		static bool runTrial(mt19937 &rng);
+
+	private:
+		static string getRandomLine(mt19937 &rng);
+		static void prescanAll(StyleScanner &scanner);
+		static bool isSamePrescan(StyleScanner &edited);
+};
+
+// Get a random line from the pool
+string ScannerTest::getRandomLine(mt19937 &rng) {
+	return LINE_POOL[rng() % POOL_SIZE];
+}
+
+// Prescan a scanner's lines from scratch
+void ScannerTest::prescanAll(StyleScanner &scanner) {
+	scanner.scanCommentLines();
+	scanner.scanNewTypeDefs();
+	scanner.scanScopeLevels();
+	scanner.scanScopeLabels();
+}
+
+// Does an incrementally edited scanner match a full prescan?
+bool ScannerTest::isSamePrescan(StyleScanner &edited) {
+	StyleScanner full;
+	full.fileLines = edited.fileLines;
+	prescanAll(full);
+	return full.commentLines == edited.commentLines
+		&& full.braceLevels == edited.braceLevels
+		&& full.scopeLevels == edited.scopeLevels
+		&& full.labelLevels == edited.labelLevels
+		&& full.newTypes == edited.newTypes
+		&& full.newTypeLines == edited.newTypeLines;
+}
+
+// Apply random edits to a random file, checking after each
+//   Returns false at the first mismatch.
+bool ScannerTest::runTrial(mt19937 &rng) {
+	StyleScanner scanner;
+	int numLines = rng() % 40;
+	for (int i = 0; i < numLines; i++) {
+		scanner.fileLines.push_back(getRandomLine(rng));
+	}
+	prescanAll(scanner);
+	for (int edit = 0; edit < EDITS_PER_TRIAL; edit++) {
+		int size = scanner.fileLines.size();
+		int start = rng() % (size + 1);
+		int numOld = rng() % (size - start + 1);
+		vector<string> newLines(rng() % 5);
+		for (string &line: newLines) {
+			line = getRandomLine(rng);
+		}
+		scanner.applyEdit(start, numOld, newLines);
+		if (!isSamePrescan(scanner)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Run the trials & report failures
+int main() {
+	mt19937 rng(42);
+	int numFailed = 0;
+	for (int trial = 0; trial < NUM_TRIALS; trial++) {
+		if (!ScannerTest::runTrial(rng)) {
+			numFailed++;
+		}
+	}
+	cout << "Failed trials: " << numFailed << " of " << NUM_TRIALS << "\n";
+	return numFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,219 @@
+/*
+	Name: inflate_test
+	Copyright: 2026
+	Author: StyleScanner contributors
+	Date: 10/17/26
+	Description: 
+		Checks the built-in DEFLATE decoder (Inflater) used for gzip
+		& zip input. Known streams (stored, fixed, & dynamic blocks,
+		made by zlib) must decode exactly; truncated, corrupt, &
+		oversized ones must fail; & randomly damaged streams must
+		fail or decode within the output limit, without crashing.
+		Build & run from the repository root (sanitizers optional):
+			g++ -std=c++11 -O2 -fsanitize=address,undefined
+				-o inflate_test tests/inflate_test.cpp
+			./inflate_test
+		Exits nonzero if any check fails.
+*/
+
+#include <random>
+
+// Rename the scanner's main(), to include it whole
+#define main styleScannerMain
+#include "../StyleScanner.cpp"
+#undef main
+
+// Raw DEFLATE streams from zlib (window bits -15), & hand-made bad ones
+// STORED (31 bytes)
+const char STORED[] =
+	"\x01\x1A\x00\xE5\xFF\x69\x6E\x74\x20\x6D\x61\x69\x6E\x28\x29\x20"
+	"\x7B\x0A\x09\x72\x65\x74\x75\x72\x6E\x20\x30\x3B\x0A\x7D\x0A";
+// FIXED (28 bytes)
+const char FIXED[] =
+	"\xCB\xCC\x2B\x51\xC8\x4D\xCC\xCC\xD3\xD0\x54\xA8\xE6\xE2\x2C\x4A"
+	"\x2D\x29\x2D\xCA\x53\x30\xB0\xE6\xAA\xE5\x02\x00";
+// FIXED_REPEATS (8 bytes)
+const char FIXED_REPEATS[] =
+	"\x4B\x4C\x4A\x4E\x1C\x7C\x08\x00";
+// DYNAMIC (999 bytes)
+const char DYNAMIC[] =
+	"\x4C\x95\x3D\xAE\x1C\x31\x0C\x83\xFB\x9C\xE2\x1D\xC1\xB6\xFE\x73"
+	"\x9B\x14\x29\x02\x2C\xD2\x25\xE7\xCF\x06\x6B\x92\xD3\x8D\x0D\x41"
+	"\xE2\x27\x53\x9A\xD7\xAF\xDF\x3F\xBF\xD6\xF7\xAF\xBF\x3F\x5E\x7F"
+	"\xDE\x1F\xDF\x5E\xFF\xCF\x1B\xE7\xFD\x39\x1F\x9C\xFD\x73\x36\x9C"
+	"\xE7\x73\x76\xC6\xE7\xE7\x22\x70\x71\xE2\x73\x91\xB8\xB0\x1B\x51"
+	"\x4C\x79\x73\x34\x2E\xF2\x16\x19\x5C\xF4\x55\xB1\x29\x73\x2F\x08"
+	"\x95\xD2\x83\x28\x8A\xDD\x7E\x33\x6D\x93\xBE\x5B\x6D\x4B\xF2\x5C"
+	"\x45\x5B\xA2\xA1\x7A\xA7\x38\x10\x45\xE1\xA7\x91\x8B\xD2\xED\xA0"
+	"\xE2\x88\x17\x3D\xA4\x7A\x87\xFA\x43\xF5\xEE\x88\x52\xAB\xFB\xE6"
+	"\x3A\x54\x1F\xE7\x56\x3C\x54\x1F\x75\x75\x1D\xAA\x4F\xA8\x3F\x54"
+	"\x9F\x8C\xA2\xFA\x62\x2E\xAA\x2F\x56\x54\xEB\xA1\xCB\xA8\x7E\xA0"
+	"\xDE\xA8\x7E\xC0\x68\xEA\xFD\x42\x2B\x4C\xCD\x5F\xE8\x98\xA9\xFB"
+	"\x1B\x8D\xB5\xD0\x53\x82\xC0\x52\x77\x78\x26\x23\xC2\x36\xBC\xA6"
+	"\xF5\xE3\xCD\x51\x97\x10\x3B\xE0\x0D\x97\x83\x12\x18\x2E\x0B\x25"
+	"\x9C\xE6\xE2\x28\xD8\xD1\xC5\xD1\xF0\xAC\x3F\x5C\x04\x63\xBB\x6C"
+	"\xB4\xC0\xE1\xF2\xD1\xC6\x88\xB8\x8C\x74\x16\xF2\x91\xE3\xD8\x42"
+	"\x5D\x72\x1C\x5F\x57\x5F\x2C\xF9\x12\x1C\x41\x8E\x93\x8C\x23\xC7"
+	"\x29\xE4\x0B\x93\x81\x51\x37\xC8\x71\x86\x23\x4C\x0E\x23\x47\x68"
+	"\x8C\x37\x78\xA3\x1E\xEE\x47\x3E\x4D\x84\xA1\x7F\xA1\x91\x70\xF4"
+	"\x39\x97\xC6\x04\x1C\x49\x0E\x2B\xBC\x5B\x92\xC3\x1A\xEF\x9B\xE4"
+	"\xB0\x81\x0F\xD2\x35\x63\xF0\x4B\x92\xC3\xE9\xAB\x24\x87\x1B\xFC"
+	"\x97\xDA\x48\x0E\x9F\x26\x39\x3C\xE1\xE7\x24\x87\x17\x7C\x5F\x9A"
+	"\x6D\x8E\x47\x91\x23\x16\xA6\xA8\xC8\x11\x1B\xC3\x56\x1A\x6F\xC3"
+	"\x4C\x96\xE6\xDB\x31\xBA\x45\x8E\xE0\x84\x57\x6A\x0F\x30\x8E\x1C"
+	"\x31\xCC\xA7\xE5\xBA\x58\x77\xB4\x30\xA0\xAF\x97\x96\x30\x38\x9A"
+	"\x1C\x19\xE0\xED\xA3\xCD\x82\xBE\x34\x39\xB2\xD1\xBF\x26\x47\x2D"
+	"\xF4\xB9\x43\x2B\x08\x1C\x4D\x8E\x32\xBC\x5B\x6B\x55\x05\xDE\xB7"
+	"\xB5\xAB\x0A\x3E\x68\x72\xD4\xC0\x2F\xB3\xF4\xEF\x00\xC7\x90\xA3"
+	"\x0F\xFC\x37\x47\x8B\x8E\xBF\x1D\x72\x74\xC2\xCF\x43\x8E\x6E\xF8"
+	"\x7E\x42\x1B\x11\x1C\x43\x8E\xB7\x14\xC4\x91\x63\x1C\xF3\x36\xAD"
+	"\xD5\x89\xB9\x1C\x72\x4C\x2F\xFE\xF1\x9E\xBF\x3C\xFE\xF4\xD6\x7E"
+	"\xAC\x59\xC5\x3E\x96\xAF\x23\xEB\x5E\x8F\xF5\x9B\xA8\xFF\x0E\x78"
+	"\x2C\x65\x28\xDD\x4B\x2B\x78\xFF\x03\x00\x00\xFF\xFF\x4D\xD5\x3D"
+	"\x8E\x95\x31\x0C\x85\xE1\x9E\x55\xCC\x12\x92\xF8\x9F\xDD\x50\x50"
+	"\x20\x8D\xE8\x60\xFD\xA4\x98\x9C\x97\xEE\xEA\x28\x8A\xFC\xC4\xF6"
+	"\x77\xD7\x89\x6F\x9F\xBF\x7E\xFF\xFC\xD8\x2B\xBF\x7F\xFC\xFD\xF1"
+	"\xF9\xE7\xFE\xDC\xC7\xF2\xA5\x45\xEA\x3E\x2F\x6D\xD2\x4C\x7F\xE9"
+	"\x90\x76\xEF\xAF\x74\x2F\xA5\x67\xAF\xF5\xD2\x4D\x6A\x47\x67\x0F"
+	"\x69\xF8\xBB\x77\x1B\x69\xE5\xAB\x61\x3B\xE9\xCC\xAB\x77\x87\x52"
+	"\x3B\xB2\x6D\x6C\xE6\xA1\xB3\xD8\x2C\x5B\xF7\x62\xB3\x39\xAA\x01"
+	"\x9B\xEF\x7C\xF5\x1E\x6C\xEE\xB2\x1D\x6C\x9E\xAE\xB3\xD8\xBC\xFB"
+	"\xDD\x7B\xB0\xC5\x75\xBC\x14\x5B\x58\xBD\x7A\x0F\xB6\x48\xD9\x0E"
+	"\xB6\x68\xCE\x62\xCB\xFF\xEE\xC5\x96\x46\x0D\xD8\x92\x7A\x0D\x5B"
+	"\x8E\x6C\x86\xAD\x78\x07\xC3\x56\xAE\x37\x33\x6C\xC5\xFB\x1A\xB6"
+	"\x1A\xF5\xC2\xB0\x35\x7D\x33\x6C\xED\xEA\xB1\x61\x6B\xE6\xC1\xB0"
+	"\xCD\xD2\xEC\x18\xB6\x61\xCE\x1C\xDB\xA4\x6C\x8E\x6D\x98\x5F\x97"
+	"\xED\xAC\xAD\x59\x77\x23\x65\x2F\xDC\x49\x4B\x3B\xE4\xB2\xDD\x05"
+	"\x90\xCD\x93\xD4\xB6\xCE\x16\x69\x2E\xDD\xDB\xA4\x17\xF7\x52\xD9"
+	"\xCE\xB9\xB5\x7D\xA5\xB1\x48\x43\xB6\xD8\xA4\xCD\x59\x6C\xB6\x75"
+	"\x6F\x60\x33\x57\x0D\x81\xCD\x4A\xF5\x06\x36\xC7\x16\xD8\xDC\xF4"
+	"\x0E\x81\xED\xEE\x85\xEE\xC5\x76\x5B\xAC\x1A\xB0\xC5\x51\x2F\x12"
+	"\x5B\xD0\xB7\xC4\x16\xA3\x1E\x27\xB6\x3C\x9A\x87\xC4\x96\xA1\xD9"
+	"\x49\x6C\x77\x50\x5F\xBD\x89\xAD\x98\xC9\xC4\x56\xA1\xF9\x4D\x6C"
+	"\xD5\x9A\xF5\xC4\x76\xA7\x5A\x35\x60\xEB\xD0\x0E\x15\xB6\x66\xDF"
+	"\x0A\xDB\xFD\x18\xE9\x2C\xB6\x09\xED\x71\x61\x9B\xD1\xCE\x97\x6C"
+	"\xB6\x8E\xBE\x0F\x15\xA4\x7C\x4B\x2A\x49\x87\xB3\xB2\xD9\xDD\x74"
+	"\xDD\xDB\xA4\x49\x0D\xB2\xD9\x5D\x8C\x57\x6F\x2F\x52\xBE\x93\xBD"
+	"\x49\x4B\xEF\xD0\xB2\x99\x6D\xBD\x59\x1B\xA9\xEB\x7D\x1B\x9B\xB5"
+	"\x7A\xD1\xD8\x9C\xBE\x35\x36\x0F\xF5\xB8\xB1\xDD\xE9\xD3\xBD\xD8"
+	"\xC2\x34\x3B\x8D\x2D\x4A\x73\x36\xD8\x92\xFF\xB7\xC1\x96\xAE\xF9"
+	"\x1D\x6C\xD9\x9A\xF5\xC1\x56\x47\x7B\x31\xD8\x2A\xB5\x43\x83\xAD"
+	"\xD9\xB7\xC1\xD6\xAE\xDD\x1C\x6C\xDD\xDA\xE3\xC1\x36\x47\x3B\x3F"
+	"\xD8\xEE\x17\x71\x7F\xFB\x07";
+// DISTANCE_TOO_FAR (3 bytes)
+const char DISTANCE_TOO_FAR[] =
+	"\x03\x02\x00";
+// OVERSUBSCRIBED (10 bytes)
+const char OVERSUBSCRIBED[] =
+	"\x05\xE0\x93\x24\x49\x92\x24\x49\x92\x00";
+// INCOMPLETE (4 bytes)
+const char INCOMPLETE[] =
+	"\x05\x00\x02\x00";
+
+// Blocks of unknown type (3), & a stored block with a bad length check
+const char RESERVED_TYPE[] = "\x07";
+const char BAD_STORED_LENGTH[] = "\x01\x05\x00\x00\x00hello";
+const int NUM_FUZZ_TRIALS = 20000;
+const size_t FUZZ_LIMIT = 4096;
+
+// A stream & the text it should decode to
+struct Sample {
+	string data;
+	string text;
+};
+
+int numChecks = 0;
+int numFailed = 0;
+
+// Count a check, reporting it if failed
+void check(bool isOk, const string &what) {
+	numChecks++;
+	if (!isOk) {
+		numFailed++;
+		cout << "Failed: " << what << "\n";
+	}
+}
+
+// Make the texts the valid streams hold
+vector<Sample> getSamples() {
+	string shortText = "int main() {\n\treturn 0;\n}\n";
+	string repeats;
+	for (int i = 0; i < 50; i++) {
+		repeats += "abc";
+	}
+	string longText;
+	for (int n = 0; n < 200; n++) {
+		longText += "line " + to_string(n) + ": value "
+			+ to_string(n * n) + "\n";
+	}
+	return {{string(STORED, sizeof STORED - 1), shortText},
+		{string(FIXED, sizeof FIXED - 1), shortText},
+		{string(FIXED_REPEATS, sizeof FIXED_REPEATS - 1), repeats},
+		{string(DYNAMIC, sizeof DYNAMIC - 1), longText}};
+}
+
+// Check a valid stream decodes exactly, & fails if cut or too big
+void checkSample(Inflater &inflater, const Sample &sample, int index) {
+	string name = "sample " + to_string(index);
+	const string &data = sample.data;
+	string out;
+	bool isOk = inflater.inflate(data.data(), data.size(), out, 1 << 20);
+	check(isOk && out == sample.text, name + " decodes");
+	isOk = inflater.inflate(data.data(), data.size(), out,
+		sample.text.size());
+	check(isOk, name + " fits an exact limit");
+	isOk = inflater.inflate(data.data(), data.size(), out,
+		sample.text.size() - 1);
+	check(!isOk, name + " fails a smaller limit");
+	for (size_t size = 0; size < data.size(); size++) {
+		isOk = inflater.inflate(data.data(), size, out, 1 << 20);
+		check(!isOk, name + " fails cut to " + to_string(size));
+	}
+}
+
+// Check that a bad stream fails
+void checkBad(Inflater &inflater, const char *data, size_t size,
+	const string &name)
+{
+	string out;
+	check(!inflater.inflate(data, size, out, 1 << 20), name + " fails");
+}
+
+// Damage valid streams at random; each must fail or fit the limit
+void fuzzSamples(Inflater &inflater, const vector<Sample> &samples) {
+	mt19937 rng(42);
+	string out;
+	for (int trial = 0; trial < NUM_FUZZ_TRIALS; trial++) {
+		string data = samples[rng() % samples.size()].data;
+		int numChanges = 1 + rng() % 4;
+		for (int i = 0; i < numChanges; i++) {
+			data[rng() % data.size()] ^= (char) (1 << rng() % 8);
+		}
+		bool isOk = inflater.inflate(data.data(), data.size(), out,
+			FUZZ_LIMIT);
+		check(!isOk || out.size() <= FUZZ_LIMIT, "fuzz trial "
+			+ to_string(trial));
+	}
+}
+
+// Run the checks & report failures
+int main() {
+	Inflater inflater;
+	vector<Sample> samples = getSamples();
+	for (int i = 0; i < (int) samples.size(); i++) {
+		checkSample(inflater, samples[i], i);
+	}
+	checkBad(inflater, "", 0, "empty input");
+	checkBad(inflater, RESERVED_TYPE, 1, "reserved block type");
+	checkBad(inflater, BAD_STORED_LENGTH, sizeof BAD_STORED_LENGTH - 1,
+		"bad stored length");
+	checkBad(inflater, DISTANCE_TOO_FAR, sizeof DISTANCE_TOO_FAR - 1,
+		"distance too far back");
+	checkBad(inflater, OVERSUBSCRIBED, sizeof OVERSUBSCRIBED - 1,
+		"over-subscribed code lengths");
+	checkBad(inflater, INCOMPLETE, sizeof INCOMPLETE - 1,
+		"incomplete code lengths");
+	fuzzSamples(inflater, samples);
+	cout << "Failed checks: " << numFailed << " of " << numChecks << "\n";
+	return numFailed == 0 ? 0 : 1;
+}